@@ -0,0 +1,874 @@
+/*****************************************************************************/
+/*
+ * PiSHi LE (Lite edition) - Fundamentals of the King's Crook graphics engine.
+ *
+ *   by EMMIR 2018-2022
+ *
+ *   YouTube: https://www.youtube.com/c/LMP88
+ *
+ * This software is released into the public domain.
+ */
+/*****************************************************************************/
+
+#include "pl.h"
+
+/*  bench.c
+ *
+ * Headless benchmark, renders into memory without opening a window
+ * and reports the time per frame of a few different configurations.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+extern void *
+EXT_calloc(unsigned n, unsigned esz)
+{
+    return calloc(n, esz);
+}
+
+extern void
+EXT_free(void *p)
+{
+    free(p);
+}
+
+extern void
+EXT_error(int err_id, char *modname, char *msg)
+{
+    printf("vx error 0x%x in %s: %s\n", err_id, modname, msg);
+    exit(1);
+}
+
+#define VW 896
+#define VH 504
+/* cube size */
+#define CUSZ 128
+/* number of frames per test */
+#define NFRAMES 200
+
+static struct PL_OBJ *texcube;
+static struct PL_OBJ *ball;
+static struct PL_OBJ *drawn_ball;
+static struct PL_OBJ *floortile;
+static struct PL_TEX rawtex;
+static struct PL_TEX bctex;
+static int checker[PL_REQ_TEX_DIM * PL_REQ_TEX_DIM];
+static int *video = NULL;
+
+static void
+maketex(void)
+{
+    int i, j, c;
+
+    for (i = 0; i < PL_REQ_TEX_DIM; i++) {
+        for (j = 0; j < PL_REQ_TEX_DIM; j++) {
+            if (((i & 0x10) ^ (j & 0x10))) {
+                c = 0x3f4f5f;
+            } else {
+                c = 0xd4ccba;
+            }
+            if (abs(i - j) < 3) {
+                c = 0x902215;
+            }
+            checker[i + j * PL_REQ_TEX_DIM] = c;
+        }
+    }
+    rawtex.data = checker;
+}
+
+/* a wall of spinning cubes that covers most of the screen */
+static void
+draw_cubes(int frame)
+{
+    int i, j;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 0, 0, 0, 0);
+    for (i = -3; i <= 3; i++) {
+        for (j = -2; j <= 2; j++) {
+            PL_mst_push();
+            PL_mst_translate(i * CUSZ * 3 / 2, j * CUSZ * 3 / 2, 700);
+            PL_mst_rotatex(frame + i * 8);
+            PL_mst_rotatey(frame + j * 8);
+            PL_render_object(texcube);
+            PL_mst_pop();
+        }
+    }
+    PL_present();
+}
+
+/* closed mesh, half of its vertices only belong to back faces */
+#define BALL_SEG 64
+#define BALL_RING 32
+
+static void
+point(int ring, int seg, int nring, int nseg)
+{
+    int a, b;
+
+    a = ring * (PL_TRIGMAX / 2) / nring;
+    b = seg * PL_TRIGMAX / nseg;
+    PL_texcoord(seg * PL_REQ_TEX_DIM / nseg,
+                ring * PL_REQ_TEX_DIM / nring);
+    PL_vertex((PL_sin[a & PL_TRIGMSK] * PL_cos[b & PL_TRIGMSK]) >> 23,
+              PL_cos[a & PL_TRIGMSK] >> 8,
+              (PL_sin[a & PL_TRIGMSK] * PL_sin[b & PL_TRIGMSK]) >> 23);
+}
+
+static struct PL_OBJ *
+gen_ball(int nring, int nseg)
+{
+    struct PL_OBJ *o;
+    int i, j;
+
+    o = calloc(1, sizeof(struct PL_OBJ));
+    if (o == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "bench", "no memory");
+    }
+    PL_ibeg();
+    PL_type(PL_QUADS);
+    for (i = 0; i < nring; i++) {
+        for (j = 0; j < nseg; j++) {
+            point(i, j, nring, nseg);
+            point(i, j + 1, nring, nseg);
+            point(i + 1, j + 1, nring, nseg);
+            point(i + 1, j, nring, nseg);
+        }
+    }
+    PL_iend();
+    PL_export(o);
+    return o;
+}
+
+/* octahedron centered on (c, c, c), every face normal is diagonal */
+static struct PL_OBJ *
+gen_octa(int c, int r)
+{
+    struct PL_OBJ *o;
+    int i, sx, sy, sz;
+
+    o = calloc(1, sizeof(struct PL_OBJ));
+    if (o == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "bench", "no memory");
+    }
+    PL_ibeg();
+    PL_type(PL_TRIANGLES);
+    PL_color(200, 140, 60);
+    for (i = 0; i < 8; i++) {
+        sx = (i & 1) ? -r : r;
+        sy = (i & 2) ? -r : r;
+        sz = (i & 4) ? -r : r;
+        PL_vertex(c + sx, c, c);
+        if ((sx ^ sy ^ sz) < 0) {
+            PL_vertex(c, c, c + sz);
+            PL_vertex(c, c + sy, c);
+        } else {
+            PL_vertex(c, c + sy, c);
+            PL_vertex(c, c, c + sz);
+        }
+    }
+    PL_iend();
+    PL_export(o);
+    return o;
+}
+
+/* the same octahedron twice, built around the origin and far from it.
+ * drawn a quarter size, both end up in one spot with the eye on the
+ * other side of the origin from the far one's vertices */
+#define OCTA_C 60000
+#define OCTA_R 8000
+static struct PL_OBJ *octa_near, *octa_far;
+
+static void
+draw_octa(int frame)
+{
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(-OCTA_C / 8, -OCTA_C / 8, -OCTA_C / 8,
+                  232, 32 + (frame & 3));
+    PL_mst_push();
+    PL_mst_translate(OCTA_C / 4, OCTA_C / 4, OCTA_C / 4);
+    PL_mst_scale(PL_P_ONE / 4, PL_P_ONE / 4, PL_P_ONE / 4);
+    PL_render_object(octa_near);
+    PL_mst_pop();
+    PL_present();
+}
+
+static void
+draw_octa_far(int frame)
+{
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(-OCTA_C / 8, -OCTA_C / 8, -OCTA_C / 8,
+                  232, 32 + (frame & 3));
+    PL_mst_push();
+    PL_mst_scale(PL_P_ONE / 4, PL_P_ONE / 4, PL_P_ONE / 4);
+    PL_render_object(octa_far);
+    PL_mst_pop();
+    PL_present();
+}
+
+/* rows of spinning balls */
+static void
+draw_balls(int frame)
+{
+    int i, j;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 0, 0, 0, 0);
+    for (i = -3; i <= 3; i++) {
+        for (j = -2; j <= 2; j++) {
+            PL_mst_push();
+            PL_mst_translate(i * 300, j * 300, 2000);
+            PL_mst_rotatex(frame + i * 8);
+            PL_mst_rotatey(frame + j * 8);
+            PL_render_object(drawn_ball);
+            PL_mst_pop();
+        }
+    }
+    PL_present();
+}
+
+/* the balls standing still in front of a still camera, but the middle
+ * one spinning. each one is its own object so it can have its own
+ * vertex cache */
+#define STILLS 35
+static struct PL_OBJ stills[STILLS];
+
+static void
+draw_still_balls(int frame)
+{
+    int i, j, n;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 0, 0, 0, 0);
+    n = 0;
+    for (i = -3; i <= 3; i++) {
+        for (j = -2; j <= 2; j++) {
+            PL_mst_push();
+            PL_mst_translate(i * 300, j * 300, 2000);
+            PL_mst_rotatex(i * 8);
+            PL_mst_rotatey(j * 8);
+            if (i == 0 && j == 0) {
+                PL_mst_rotatey(frame * 4);
+            }
+            PL_render_object(&stills[n++]);
+            PL_mst_pop();
+        }
+    }
+    PL_present();
+}
+
+/* balls going off into the distance, smaller with every row */
+static void
+draw_far_balls(int frame)
+{
+    int i, j;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 0, 0, 0, 0);
+    for (i = -3; i <= 3; i++) {
+        for (j = 0; j < 5; j++) {
+            PL_mst_push();
+            PL_mst_translate(i * (300 + j * 200), -200 + j * 300,
+                             1000 + j * 1200);
+            PL_mst_rotatex(frame + i * 8);
+            PL_mst_rotatey(frame + j * 8);
+            PL_render_object(drawn_ball);
+            PL_mst_pop();
+        }
+    }
+    PL_present();
+}
+
+/* the far balls turning slowly, drawn as they are or as impostors */
+static int as_impostors;
+
+static void
+draw_slow_balls(int frame)
+{
+    int i, j;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 0, 0, 0, 0);
+    for (i = -3; i <= 3; i++) {
+        for (j = 0; j < 5; j++) {
+            PL_mst_push();
+            PL_mst_translate(i * (300 + j * 200), -200 + j * 300,
+                             1000 + j * 1200);
+            PL_mst_rotatex((frame >> 3) + i * 8);
+            PL_mst_rotatey((frame >> 3) + j * 8);
+            if (as_impostors) {
+                PL_render_impostor(drawn_ball, (i + 3) * 5 + j, 48);
+            } else {
+                PL_render_object(drawn_ball);
+            }
+            PL_mst_pop();
+        }
+    }
+    PL_present();
+}
+
+/* a floor of small tiles seen from above, one matrix per tile */
+#define TILES 24
+static int tiles[TILES * TILES * 16];
+static struct PL_OBJ *tileobjs[TILES * TILES];
+static int oddtiles[2 * 16]; /* one stretched, one mirrored */
+
+static void
+maketiles(void)
+{
+    int idt[16] = PL_IDT_MAT;
+    int i, j, *m;
+
+    m = tiles;
+    for (i = 0; i < TILES; i++) {
+        for (j = 0; j < TILES; j++) {
+            PL_mat_cpy(m, idt);
+            m[12] = (i - TILES / 2) * CUSZ;
+            m[14] = j * CUSZ;
+            m += 16;
+        }
+    }
+}
+
+static void
+draw_tiles(int frame)
+{
+    int i;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 2000, -300, 40, (frame >> 4) & 7);
+    for (i = 0; i < TILES * TILES; i++) {
+        PL_mst_push();
+        PL_mst_mul(tiles + i * 16);
+        PL_render_object(floortile);
+        PL_mst_pop();
+    }
+    PL_present();
+}
+
+static void
+draw_tiles_instanced(int frame)
+{
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 2000, -300, 40, (frame >> 4) & 7);
+    PL_render_instances(floortile, tiles, TILES * TILES);
+    PL_present();
+}
+
+static struct PL_OBJ *batches;
+static int n_batches;
+
+static void
+draw_tiles_batched(int frame)
+{
+    int i;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 2000, -300, 40, (frame >> 4) & 7);
+    for (i = 0; i < n_batches; i++) {
+        PL_render_object(&batches[i]);
+    }
+    PL_present();
+}
+
+/* a 100x100 field of cubes looked down on, only a few are in view */
+#define FIELD 100
+static int *field;
+static struct PL_SCENE scene;
+
+static void
+makefield(void)
+{
+    int i, j, *m;
+
+    field = calloc(FIELD * FIELD * 16, sizeof(int));
+    if (field == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "bench", "no memory");
+    }
+    m = field;
+    for (i = 0; i < FIELD; i++) {
+        for (j = 0; j < FIELD; j++) {
+            PL_mst_push();
+            PL_mst_load_idt();
+            PL_mst_translate((i - FIELD / 2) * 300, 0, (j - FIELD / 2) * 300);
+            PL_mst_rotatey(i * j);
+            PL_mst_get(m);
+            PL_mst_pop();
+            PL_scene_add(&scene, texcube, m);
+            m += 16;
+        }
+    }
+    PL_scene_build(&scene);
+}
+
+static void
+draw_field(int frame)
+{
+    int i;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 1200, 0, 50, frame);
+    for (i = 0; i < FIELD * FIELD; i++) {
+        PL_mst_push();
+        PL_mst_mul(field + i * 16);
+        PL_render_object(texcube);
+        PL_mst_pop();
+    }
+    PL_present();
+}
+
+static void
+draw_field_scene(int frame)
+{
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 1200, 0, 50, frame);
+    PL_scene_render(&scene);
+    PL_present();
+}
+
+/* the field with a camera that only turns every 8th frame */
+static void
+field_turns(int frame)
+{
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 1200, 0, 50, frame >> 3);
+    PL_scene_render(&scene);
+}
+
+static void
+draw_field_turns(int frame)
+{
+    field_turns(frame);
+    PL_present();
+}
+
+static int skipped;
+
+static void
+draw_field_probed(int frame)
+{
+    PL_probe_begin();
+    field_turns(frame);
+    if (!PL_probe_end()) {
+        skipped++;
+        return;
+    }
+    field_turns(frame);
+    PL_present();
+}
+
+/* a still camera over the field with a few cubes spinning in front */
+#define PROPS 6
+
+static void
+draw_props(int frame)
+{
+    int i;
+
+    for (i = 0; i < PROPS; i++) {
+        PL_mst_push();
+        PL_mst_translate((i - PROPS / 2) * 200, 200, 600);
+        PL_mst_rotatey(frame + i * 20);
+        PL_render_object(texcube);
+        PL_mst_pop();
+    }
+}
+
+static void
+draw_field_props(int frame)
+{
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 1200, 0, 50, 0);
+    PL_scene_render(&scene);
+    draw_props(frame);
+    PL_present();
+}
+
+static void
+draw_field_props_layer(int frame)
+{
+    PL_set_camera(0, 1200, 0, 50, 0);
+    if (!PL_layer_restore()) {
+        PL_clear_vp(0, 0, 0);
+        PL_scene_render(&scene);
+        PL_layer_save();
+    }
+    draw_props(frame);
+    PL_present();
+}
+
+/* rows of still, jointed arms, every segment hangs off the last one */
+#define ARMS 35
+#define SEGS 8
+static struct PL_OBJ *segment;
+static struct PL_XFNODE joints[ARMS][SEGS];
+
+/* apply the joint of segment j of arm i to the matrix stack */
+static void
+joint(int i, int j)
+{
+    if (j == 0) {
+        PL_mst_translate((i % 7 - 3) * 250, (i / 7 - 2) * 200 - 100, 1500);
+    } else {
+        PL_mst_translate(0, 48, 0);
+    }
+    PL_mst_rotatez(i * 3 + j * 5);
+    PL_mst_rotatex(j * 4);
+}
+
+static void
+makearms(void)
+{
+    int m[16];
+    int i, j;
+
+    segment = PL_gen_box(16, 48, 16, PL_ALL, 180, 160, 120);
+    for (i = 0; i < ARMS; i++) {
+        for (j = 0; j < SEGS; j++) {
+            PL_xf_init(&joints[i][j], j ? &joints[i][j - 1] : NULL);
+            PL_mst_push();
+            PL_mst_load_idt();
+            joint(i, j);
+            PL_mst_get(m);
+            PL_mst_pop();
+            PL_xf_set(&joints[i][j], m);
+        }
+    }
+}
+
+static void
+draw_arms(int frame)
+{
+    int i, j;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 0, 0, 0, frame & 7);
+    for (i = 0; i < ARMS; i++) {
+        PL_mst_push();
+        for (j = 0; j < SEGS; j++) {
+            joint(i, j);
+            PL_render_object(segment);
+        }
+        PL_mst_pop();
+    }
+    PL_present();
+}
+
+static void
+draw_arms_cached(int frame)
+{
+    int i, j;
+
+    PL_clear_vp(0, 0, 0);
+    PL_set_camera(0, 0, 0, 0, frame & 7);
+    PL_mst_push();
+    for (i = 0; i < ARMS; i++) {
+        for (j = 0; j < SEGS; j++) {
+            PL_xf_load(&joints[i][j]);
+            PL_render_object(segment);
+        }
+    }
+    PL_mst_pop();
+    PL_present();
+}
+
+/* allocate a video buffer of the given size and start PL on it */
+static void
+setres(int w, int h, int fov)
+{
+    if (video) {
+        free(video);
+    }
+    video = calloc(w * h, sizeof(int));
+    if (video == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "bench", "no memory");
+    }
+    PL_init(video, w, h);
+    PL_fov = fov;
+}
+
+/* returns microseconds per frame */
+static long
+run(char *name, void (*draw)(int))
+{
+    clock_t beg;
+    long us;
+    int i;
+
+    beg = clock();
+    for (i = 0; i < NFRAMES; i++) {
+        PL_polygon_count = 0;
+        PL_guard_band_count = 0;
+        draw(i);
+    }
+    us = (long) (clock() - beg) * 1000 / (CLOCKS_PER_SEC / 1000) / NFRAMES;
+    printf("%-24s %7ld us/frame %6d polygons %4d unclipped in guard band\n",
+            name, us, PL_polygon_count, PL_guard_band_count);
+    return us;
+}
+
+/* vertices in the transform test */
+#define XFVERTS (100 * 1024)
+
+/* transform XFVERTS vertices in both layouts */
+static void
+bench_xf(void)
+{
+    int *aos, *soa, *out;
+    int i, j;
+    clock_t beg;
+    long us[2];
+
+    aos = calloc(XFVERTS * PL_VLEN, sizeof(int));
+    soa = calloc(XFVERTS * 3, sizeof(int));
+    out = calloc(XFVERTS * PL_VLEN, sizeof(int));
+    if (!aos || !soa || !out) {
+        EXT_error(PL_ERR_NO_MEM, "bench", "no memory");
+    }
+    for (i = 0; i < XFVERTS; i++) {
+        for (j = 0; j < 3; j++) {
+            aos[i * PL_VLEN + j] = (rand() & 0x3ff) - 0x200;
+            soa[(i / PL_SOA_BLK) * PL_SOA_BLK * 3 + j * PL_SOA_BLK +
+                (i % PL_SOA_BLK)] = aos[i * PL_VLEN + j];
+        }
+    }
+    PL_set_camera(10, 20, -300, 5, 7);
+    PL_mst_push();
+    PL_mst_translate(0, 0, 1000);
+    PL_mst_rotatex(20);
+    PL_mst_rotatey(30);
+    for (j = 0; j < 2; j++) {
+        beg = clock();
+        for (i = 0; i < NFRAMES; i++) {
+            if (j) {
+                PL_mst_xf_modelview_soa(soa, out, XFVERTS);
+            } else {
+                PL_mst_xf_modelview_vec(aos, out, XFVERTS);
+            }
+        }
+        us[j] = (long) (clock() - beg) * 1000 /
+                (CLOCKS_PER_SEC / 1000) / NFRAMES;
+        printf("%-24s %7ld us/frame %6d vertices\n",
+                j ? "soa transform" : "transform", us[j], XFVERTS);
+    }
+    PL_mst_pop();
+    free(aos);
+    free(soa);
+    free(out);
+}
+
+/* one resolution of the scaling test */
+struct RES {
+    char *name;
+    int w, h;
+    int fov; /* +1 per doubling so the scene covers the same share */
+};
+
+static struct RES ress[] = {
+    { "960x540",           960,  540,  9 },
+    { "1920x1080",        1920, 1080, 10 },
+    { "3840x2160 (4K)",   3840, 2160, 11 },
+    { "2160x3840 (4K portrait)", 2160, 3840, 11 },
+    { "7680x4320 (8K)",   7680, 4320, 12 },
+    { "8000x4500 (near PL_MAX_SCREENSIZE)", 8000, 4500, 12 }
+};
+
+int
+main(void)
+{
+    long raw, bc, us;
+    int saved, i, npx, nv;
+
+    setres(VW, VH, 9);
+    maketex();
+
+    texcube = PL_gen_box(CUSZ, CUSZ, CUSZ, PL_ALL, 255, 255, 255);
+    PL_cull_mode = PL_CULL_BACK;
+    PL_raster_mode = PL_TEXTURED;
+
+    printf("%dx%d, %d frames per test\n", VW, VH, NFRAMES);
+
+    /* texture formats */
+    bctex.data = checker;
+    saved = PL_tex_compress(&bctex);
+    bctex.data = NULL;
+    PL_cur_tex = &rawtex;
+    raw = run("texture", draw_cubes);
+    PL_cur_tex = &bctex;
+    bc = run("compressed texture", draw_cubes);
+    printf("texture memory: %d bytes, compressed: %d bytes (%d saved)\n",
+            (int) (PL_REQ_TEX_DIM * PL_REQ_TEX_DIM * sizeof(int)),
+            (int) (PL_BC_BLOCKS * 2 * sizeof(int)), saved);
+    printf("compressed texture time: %ld%% of uncompressed\n",
+            raw ? (bc * 100 / raw) : 0);
+
+    bench_xf();
+
+    /* vertex transform on demand */
+    ball = gen_ball(BALL_RING, BALL_SEG);
+    drawn_ball = ball;
+    PL_cur_tex = &rawtex;
+    PL_lazy_xf = 0;
+    raw = run("balls", draw_balls);
+    PL_lazy_xf = 1;
+    us = run("balls, lazy transform", draw_balls);
+    PL_lazy_xf = 0;
+    printf("lazy transform time: %ld%% of transform all\n",
+            raw ? (us * 100 / raw) : 0);
+
+    /* the same balls culled in clusters first */
+    drawn_ball = calloc(1, sizeof(struct PL_OBJ));
+    if (drawn_ball == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "bench", "no memory");
+    }
+    PL_copy_object(drawn_ball, ball);
+    PL_cluster_object(drawn_ball);
+    us = run("balls, clustered", draw_balls);
+    printf("%-24s %7d clusters per ball\n", "", drawn_ball->n_clusters);
+    printf("clustered time: %ld%% of unclustered\n",
+            raw ? (us * 100 / raw) : 0);
+    PL_delete_object(drawn_ball);
+    free(drawn_ball);
+
+    /* far from the origin the planes must not overflow, both have to
+     * draw the same faces */
+    octa_near = gen_octa(0, OCTA_R);
+    octa_far = gen_octa(OCTA_C, OCTA_R);
+    run("octahedron", draw_octa);
+    run("octahedron, far", draw_octa_far);
+
+    /* vertices transformed once while nothing moves */
+    for (i = 0; i < STILLS; i++) {
+        PL_copy_object(&stills[i], ball);
+    }
+    raw = run("still balls", draw_still_balls);
+    for (i = 0; i < STILLS; i++) {
+        PL_cache_object(&stills[i]);
+    }
+    us = run("still balls, cached", draw_still_balls);
+    printf("vertex cache time: %ld%% of transforming every frame\n",
+            raw ? (us * 100 / raw) : 0);
+    for (i = 0; i < STILLS; i++) {
+        PL_delete_object(&stills[i]);
+    }
+
+    /* levels of detail, halving the segments each level */
+    drawn_ball = ball;
+    raw = run("far balls", draw_far_balls);
+    for (i = 1; i < 4; i++) {
+        PL_add_lod(ball, gen_ball(BALL_RING >> i, BALL_SEG >> i), 64 >> i);
+    }
+    for (i = 0; i <= PL_MAX_LODS; i++) {
+        PL_lod_polygons[i] = 0;
+    }
+    PL_lod_saved = 0;
+    us = run("far balls, lod", draw_far_balls);
+    for (i = 0; i <= ball->n_lods; i++) {
+        printf("%-24s %7d polygons at level %d\n", "",
+                PL_lod_polygons[i] / NFRAMES, i);
+    }
+    printf("%-24s %7d polygons saved\n", "", PL_lod_saved / NFRAMES);
+    printf("lod time: %ld%% of full detail\n", raw ? (us * 100 / raw) : 0);
+
+    /* distant balls as textured quads, rendered again as they turn */
+    as_impostors = 0;
+    raw = run("slow balls", draw_slow_balls);
+    PL_impostor_budget(40 * PL_REQ_TEX_DIM * PL_REQ_TEX_DIM * sizeof(int));
+    PL_impostor_updates = 0;
+    as_impostors = 1;
+    us = run("slow balls, impostors", draw_slow_balls);
+    printf("%-24s %7d impostors rendered\n", "", PL_impostor_updates);
+    printf("impostor time: %ld%% of drawing the objects\n",
+            raw ? (us * 100 / raw) : 0);
+    PL_impostor_budget(0);
+
+    /* the same prop many times */
+    floortile = PL_gen_box(CUSZ, CUSZ, CUSZ, PL_TOP, 77, 101, 94);
+    maketiles();
+    raw = run("tiles", draw_tiles);
+    us = run("tiles, instanced", draw_tiles_instanced);
+    printf("instanced time: %ld%% of one call per tile\n",
+            raw ? (us * 100 / raw) : 0);
+    for (i = 0; i < TILES * TILES; i++) {
+        tileobjs[i] = floortile;
+    }
+    batches = PL_batch_objects(tileobjs, tiles, TILES * TILES, 1024,
+                               &n_batches);
+    us = run("tiles, batched", draw_tiles_batched);
+    nv = 0;
+    for (i = 0; i < n_batches; i++) {
+        nv += batches[i].n_verts;
+    }
+    printf("%-24s %7d batches, %d of %d vertices after welding\n", "",
+            n_batches, nv, TILES * TILES * floortile->n_verts);
+    printf("batched time: %ld%% of one call per tile\n",
+            raw ? (us * 100 / raw) : 0);
+    for (i = 0; i < n_batches; i++) {
+        PL_delete_object(&batches[i]);
+    }
+    EXT_free(batches);
+
+    /* stretched and mirrored tiles still have to face up once baked */
+    PL_mat_cpy(oddtiles + 0, tiles);
+    PL_mat_cpy(oddtiles + 16, tiles);
+    oddtiles[0] = oddtiles[10] = PL_P_ONE * 3 / 2;
+    oddtiles[16] = -PL_P_ONE;
+    batches = PL_batch_objects(tileobjs, oddtiles, 2, 0, &n_batches);
+    nv = 0;
+    for (i = 0; i < batches[0].n_polys; i++) {
+        nv += (batches[0].polys[i].plane[1] ^
+               floortile->polys[0].plane[1]) >= 0;
+    }
+    printf("%-24s %7d of 2 stretched or mirrored tiles face up\n", "", nv);
+    PL_delete_object(&batches[0]);
+    EXT_free(batches);
+
+    /* transform hierarchies that don't move */
+    makearms();
+    raw = run("arms", draw_arms);
+    us = run("arms, cached transforms", draw_arms_cached);
+    printf("cached transform time: %ld%% of rebuilding the chain\n",
+            raw ? (us * 100 / raw) : 0);
+
+    /* a big scene, few of it visible */
+    makefield();
+    raw = run("field", draw_field);
+    us = run("field, scene", draw_field_scene);
+    printf("%-24s %7d of %d objects visible\n", "",
+            scene.n_visible, FIELD * FIELD);
+    printf("scene time: %ld%% of drawing every object\n",
+            raw ? (us * 100 / raw) : 0);
+
+    /* frames that would repeat the last one are skipped */
+    raw = run("field, turns", draw_field_turns);
+    skipped = 0;
+    us = run("field, turns, probed", draw_field_probed);
+    printf("%-24s %7d of %d frames skipped\n", "", skipped, NFRAMES);
+    printf("probed time: %ld%% of drawing every frame\n",
+            raw ? (us * 100 / raw) : 0);
+
+    /* only the props are drawn over the saved field */
+    raw = run("field, props", draw_field_props);
+    us = run("field, props, layer", draw_field_props_layer);
+    printf("static layer time: %ld%% of drawing everything\n",
+            raw ? (us * 100 / raw) : 0);
+    PL_layer_invalidate();
+    PL_scene_delete(&scene);
+    free(field);
+
+    /* resolution scaling, throughput should stay about the same */
+    PL_cur_tex = &rawtex;
+    for (i = 0; i < (int) (sizeof(ress) / sizeof(*ress)); i++) {
+        setres(ress[i].w, ress[i].h, ress[i].fov);
+        us = run(ress[i].name, draw_cubes);
+        npx = ress[i].w * ress[i].h;
+        printf("%-24s %7ld pixels/ms\n", "", us ? (npx * 1000L / us) : 0);
+    }
+    PL_cur_tex = NULL;
+
+    free(video);
+    return 0;
+}
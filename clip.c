@@ -19,6 +19,7 @@
  */
 
 #include <string.h>
+#include <limits.h>
 
 /* special return code specifying the edge was not clipped */
 #define PL_NC    0777
@@ -258,3 +259,156 @@ PL_frustum_test(int minz, int maxz)
     }
     return outc;
 }
+
+/* frustum side planes in view space, normals are (n, 0 or d) with
+ * 14 bits of precision. recomputed when the fov or viewport change */
+#define FR_P 14
+
+static int fr_key[7] = { -1 };
+static int fr_lf[2], fr_rt[2], fr_tp[2], fr_bt[2];
+
+static void
+fr_plane(int *pl, int f, int d)
+{
+    int len;
+
+    if (d < 0) {
+        d = 0;
+    }
+    len = PL_isqrt(f * f + d * d);
+    pl[0] = (f << FR_P) / len;
+    pl[1] = (d << FR_P) / len;
+}
+
+static void
+fr_update(void)
+{
+    int f;
+
+    if (fr_key[0] == PL_fov &&
+        fr_key[1] == PL_vp_min_x && fr_key[2] == PL_vp_max_x &&
+        fr_key[3] == PL_vp_min_y && fr_key[4] == PL_vp_max_y &&
+        fr_key[5] == PL_vp_cen_x && fr_key[6] == PL_vp_cen_y) {
+        return;
+    }
+    fr_key[0] = PL_fov;
+    fr_key[1] = PL_vp_min_x;
+    fr_key[2] = PL_vp_max_x;
+    fr_key[3] = PL_vp_min_y;
+    fr_key[4] = PL_vp_max_y;
+    fr_key[5] = PL_vp_cen_x;
+    fr_key[6] = PL_vp_cen_y;
+
+    /* a point projects to x * f / z + center, the viewport edges are
+     * moved out by a pixel to stay conservative */
+    f = 1 << PL_fov;
+    fr_plane(fr_lf, f, PL_vp_cen_x - PL_vp_min_x + 1);
+    fr_plane(fr_rt, f, PL_vp_max_x - PL_vp_cen_x + 1);
+    fr_plane(fr_tp, f, PL_vp_cen_y - PL_vp_min_y + 1);
+    fr_plane(fr_bt, f, PL_vp_max_y - PL_vp_cen_y + 1);
+}
+
+extern int
+PL_sphere_frustum_test(int *s)
+{
+    int x, y, z, r;
+    int d[4];
+    int i, zfar, inside;
+
+    z = s[2];
+    r = s[3];
+    /* near and far */
+    if ((z + r) <= PL_Z_NEAR_PLANE) {
+        return PL_VIS_OUTSIDE;
+    }
+    zfar = 1 << (PL_fov + 12); /* 1/z projects to 0 past here */
+    if ((z - r) >= zfar) {
+        return PL_VIS_OUTSIDE;
+    }
+    inside = ((z - r) > PL_Z_NEAR_PLANE) && ((z + r) < zfar);
+
+    fr_update();
+    x = s[0];
+    y = s[1];
+    /* bring into range of the 14 bit normals */
+    while (x > 32767 || x < -32768 || y > 32767 || y < -32768 ||
+           z > 32767 || z < -32768 || r > 32767) {
+        x >>= 1;
+        y >>= 1;
+        z >>= 1;
+        r = (r >> 1) + 1;
+    }
+    /* signed distances to the four side planes */
+    d[0] = (x * fr_lf[0] + z * fr_lf[1]) >> FR_P;
+    d[1] = (z * fr_rt[1] - x * fr_rt[0]) >> FR_P;
+    d[2] = (z * fr_tp[1] - y * fr_tp[0]) >> FR_P;
+    d[3] = (z * fr_bt[1] + y * fr_bt[0]) >> FR_P;
+    for (i = 0; i < 4; i++) {
+        if (d[i] < -r) {
+            return PL_VIS_OUTSIDE;
+        }
+        if (d[i] <= r) {
+            inside = 0;
+        }
+    }
+    return inside ? PL_VIS_INSIDE : PL_VIS_PARTIAL;
+}
+
+extern void
+PL_outcodes(int *v, int *proj, int num)
+{
+    int x, y, z, q, oc, ffac, lim;
+
+    ffac = 1 << (PL_fov + 12);
+    while (num--) {
+        x = v[0];
+        y = v[1];
+        z = v[2];
+        oc = 0;
+        if (z <= PL_Z_NEAR_PLANE) {
+            oc |= PL_OC_NEAR;
+        }
+        if (z < PL_Z_NEAR_PLANE) {
+            /* the clipped polygon gets new vertices, can't tell more */
+            v[3] = oc | PL_OC_CLIP | PL_OC_NOPROJ;
+            v += PL_VLEN;
+            if (proj) {
+                proj += PL_VLEN;
+            }
+            continue;
+        }
+        /* project the same way PL_psp_project does so the codes agree
+         * exactly with what the 2D clipper will see */
+        q = ffac / z;
+        lim = q ? (INT_MAX - (1 << 11)) / q : INT_MAX;
+        if (x > lim || x < -lim) {
+            oc |= (x < 0) ? PL_OC_LEFT : PL_OC_RIGHT;
+            oc |= PL_OC_NOPROJ;
+        } else {
+            x = ((x * q + (1 << 11)) >> 12) + PL_vp_cen_x;
+            if (x <= PL_vp_min_x) oc |= PL_OC_LEFT;
+            if (x >= PL_vp_max_x) oc |= PL_OC_RIGHT;
+        }
+        if (y > lim || y < -lim) {
+            oc |= (y < 0) ? PL_OC_BOTTOM : PL_OC_TOP;
+            oc |= PL_OC_NOPROJ;
+        } else {
+            y = PL_vp_cen_y - ((y * q + (1 << 11)) >> 12);
+            if (y <= PL_vp_min_y) oc |= PL_OC_TOP;
+            if (y >= PL_vp_max_y) oc |= PL_OC_BOTTOM;
+        }
+        /* on the viewport edge counts as outside, the clipper would
+         * touch it. anything outside needs clipping */
+        if (oc) {
+            oc |= PL_OC_CLIP;
+        }
+        v[3] = oc;
+        v += PL_VLEN;
+        if (proj) {
+            proj[0] = x;
+            proj[1] = y;
+            proj[2] = q >> (PL_fov - 8); /* 1/Z in 12.20 */
+            proj += PL_VLEN;
+        }
+    }
+}
@@ -89,6 +89,10 @@ extern void sys_kill    (void); /* instantaneous shutdown */
 extern int  sys_poll    (void); /* poll the operating system for events */
 extern int  sys_getfps  (void); /* get current fps of system */
 extern void sys_capfps  (int cap); /* limit fps to hz specified by sys_sethz */
+/* call from the display callback when the frame was skipped because nothing
+ * changed, the loop then sleeps until input arrives or the next update is
+ * due instead of calling the display callback again right away */
+extern void sys_idle    (void);
 /***********************************************************************/
 
 #define FW_VFLAG_NONE      000
@@ -103,6 +107,9 @@ extern void sys_capfps  (int cap); /* limit fps to hz specified by sys_sethz */
 /* open video context with given title, resolution, and scale */
 extern int  vid_open(char *title, int width, int height, int scale, int flags);
 extern void vid_blit       (void); /* draw image onto window */
+/* draw a w x h image from the start of video memory, stretched to the window,
+ * for rendering at a lower resolution than the one passed to vid_open */
+extern void vid_blitsub    (int w, int h);
 extern void vid_sync       (void); /* sync (behavior is OS-dependent) */
 extern VIDINFO *vid_getinfo(void); /* get current video info */
 
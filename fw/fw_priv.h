@@ -31,6 +31,7 @@ extern "C" {
 extern void clk_init      (void); /* initialize clock interface */
 extern void pkb_poll      (void); /* gets called every loop */
 extern int  wnd_osm_handle(void); /* poll the operating system for events */
+extern void wnd_osm_wait  (int ms); /* wait up to ms for an OS event */
 extern void wnd_term      (void); /* clean up and close the active window */
 
 #ifdef __cplusplus
@@ -28,6 +28,7 @@ static int upd_period = 14; /* 1000 / 70 */
 static int cap_fps = 0;
 static int fps = 0;
 static int req_shutdown = 0;
+static int idle = 0;
 
 static void def_func(void)        {}
 static void (*update_func)(void)  = def_func;
@@ -145,13 +146,16 @@ sys_start(void)
         curclk = clk_sample();
         dt = curclk - prvclk;
         if (dt < upd_period) {
-            if (!cap_fps) {
+            if (idle) {
+                wnd_osm_wait(upd_period - dt);
+            } else if (!cap_fps) {
                 display_func();
                 tfps++;
             }
             continue;
         }
         prvclk = curclk;
+        idle = 0;
         pkb_poll();
         update_func();        
         display_func();
@@ -190,6 +194,13 @@ sys_poll(void)
     return wnd_osm_handle();
 }
 
+extern void
+sys_idle(void)
+{
+    /* cleared again at the next update */
+    idle = 1;
+}
+
 extern void
 sys_capfps(int cap)
 {
@@ -85,6 +85,9 @@ static struct {
 static HBITMAP FWi_hbmp;
 
 static int FWi_ignorekeyrepeat = 0;
+/* size of the last image put on the window, for repainting it */
+static int last_w = 0;
+static int last_h = 0;
 
 static void def_keyboard_func(int key) {}
 static void(*FWi_keyboard_func)(int key)   = def_keyboard_func;
@@ -115,8 +118,15 @@ readevent(MSG *msg)
 static LRESULT CALLBACK
 os_message_handler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
+	PAINTSTRUCT ps;
+
 	switch (msg) {
 		case WM_PAINT:
+			/* frames may be skipped while nothing changes,
+			 * so repaint from the last image shown */
+			BeginPaint(hWnd, &ps);
+			EndPaint(hWnd, &ps);
+			vid_blitsub(last_w, last_h);
 			break;
 		case WM_ERASEBKGND:
 			return 1;
@@ -270,6 +280,8 @@ vid_blit(void)
 	if (!FW_curinfo.video) {
 		return;
 	}
+	last_w = 0; /* the whole image */
+	last_h = 0;
 	hdc = GetDC(FWi_wnd);
 	mdc = CreateCompatibleDC(hdc);
 	SelectObject(mdc, FWi_hbmp);
@@ -289,6 +301,43 @@ vid_blit(void)
 	ReleaseDC(FWi_wnd, hdc);
 }
 
+extern void
+vid_blitsub(int w, int h)
+{
+    BITMAPINFO binfo;
+    HDC hdc;
+
+	if (!FW_curinfo.video) {
+		return;
+	}
+	if (w < 1 || w > FW_curinfo.width) {
+	    w = FW_curinfo.width;
+	}
+	if (h < 1 || h > FW_curinfo.height) {
+	    h = FW_curinfo.height;
+	}
+	last_w = w;
+	last_h = h;
+	if (w == FW_curinfo.width && h == FW_curinfo.height) {
+	    vid_blit();
+	    return;
+	}
+	/* describe the smaller image packed at the start of video memory */
+	memset(&binfo, 0, sizeof(binfo));
+	binfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	binfo.bmiHeader.biWidth = w;
+	binfo.bmiHeader.biHeight = -h;
+	binfo.bmiHeader.biPlanes = 1;
+	binfo.bmiHeader.biBitCount = FW_curinfo.bytespp * 8;
+	binfo.bmiHeader.biCompression = BI_RGB;
+
+	GdiFlush();
+	hdc = GetDC(FWi_wnd);
+	StretchDIBits(hdc, 0, 0, deviceinfo.width, deviceinfo.height,
+	        0, 0, w, h, FW_curinfo.video, &binfo, DIB_RGB_COLORS, SRCCOPY);
+	ReleaseDC(FWi_wnd, hdc);
+}
+
 extern void
 vid_sync(void)
 {
@@ -332,6 +381,14 @@ wnd_osm_handle(void)
 	return 0;
 }
 
+extern void
+wnd_osm_wait(int ms)
+{
+	/* also wakes for messages already in the queue */
+	MsgWaitForMultipleObjectsEx(0, NULL, (DWORD) ms,
+	        QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+}
+
 extern void
 wnd_term(void)
 {
@@ -35,6 +35,7 @@
 #endif
 #include <sys/time.h>
 #include <time.h>
+#include <poll.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
@@ -87,10 +88,11 @@ static struct {
 
 #define FW_XEVENT_MASK \
         (KeyPressMask        | KeyReleaseMask    | \
-         StructureNotifyMask | FocusChangeMask   | \
+         StructureNotifyMask | FocusChangeMask   | ExposureMask | \
          ButtonPressMask     | ButtonReleaseMask | PointerMotionMask)
 
 static void xkey_callb(XKeyEvent *event);
+static void putimage(void);
 
 static void close_xdisplay(void);
 
@@ -148,6 +150,13 @@ readevent(XEvent *e)
         case MappingNotify:
             XRefreshKeyboardMapping(&e->xmapping);
             return 1;
+        case Expose:
+            /* frames may be skipped while nothing changes,
+             * so repaint from the last image shown */
+            if (e->xexpose.count == 0) {
+                putimage();
+            }
+            return 1;
         default:
             return 1;
     }
@@ -521,8 +530,32 @@ resizevideo(unsigned *src, unsigned sw, unsigned sh,
 {
     register unsigned *t, *p;
     int ratx, raty, acc;
-    unsigned x, y;
-
+    unsigned x, y, i, kx, ky;
+
+    if (((dw % sw) == 0) && ((dh % sh) == 0)) {
+        /* integer ratio, repeat each pixel and then the whole row */
+        kx = dw / sw;
+        ky = dh / sh;
+        for (y = 0; y < sh; y++) {
+            t = dst;
+            p = src + y * sw;
+            if (kx == 1) {
+                memcpy(t, p, sw * 4);
+            } else {
+                for (x = 0; x < sw; x++) {
+                    for (i = 0; i < kx; i++) {
+                        *t++ = *p;
+                    }
+                    p++;
+                }
+            }
+            for (i = 1; i < ky; i++) {
+                memcpy(dst + i * dw, dst, dw * 4);
+            }
+            dst += dw * ky;
+        }
+        return;
+    }
     ratx = ((sw << 16) / dw) + 1;
     raty = ((sh << 16) / dh) + 1;
     for (y = 0; y < dh; y++) {
@@ -537,10 +570,9 @@ resizevideo(unsigned *src, unsigned sw, unsigned sh,
 }
 
 extern void
-vid_blit(void)
+vid_blitsub(int w, int h)
 {
     Display *d;
-    Window w;
     unsigned *v;
     unsigned sw, sh, dw, dh;
 
@@ -549,26 +581,54 @@ vid_blit(void)
     if ((v == NULL) || (d == NULL)) {
         return;
     }
-    w  = FWi_x.window;
-    sw = FW_curinfo.width;
-    sh = FW_curinfo.height;
+    if (w < 1 || w > FW_curinfo.width) {
+        w = FW_curinfo.width;
+    }
+    if (h < 1 || h > FW_curinfo.height) {
+        h = FW_curinfo.height;
+    }
+    sw = w;
+    sh = h;
     dw = deviceinfo.width;
     dh = deviceinfo.height;
 
-    if (deviceinfo.scale == 1) {
+    if ((sw == dw) && (sh == dh)) {
         memcpy(FWi_x.ximage->data, v, dw * dh * 4);
     } else {
         resizevideo(v, sw, sh, (unsigned *) FWi_x.ximage->data, dw, dh);
     }
+    putimage();
+}
+
+static void
+putimage(void)
+{
+    Display *d;
+    Window wnd;
+    unsigned dw, dh;
+
+    d = FWi_x.display;
+    if ((d == NULL) || (FWi_x.ximage == NULL)) {
+        return;
+    }
+    wnd = FWi_x.window;
+    dw = deviceinfo.width;
+    dh = deviceinfo.height;
     if (FWi_x.use_shm) {
 #if FW_X11_HAS_SHM_EXT
-        XShmPutImage(d, w, FWi_x.gc, FWi_x.ximage, 0, 0, 0, 0, dw, dh, False);
+        XShmPutImage(d, wnd, FWi_x.gc, FWi_x.ximage, 0, 0, 0, 0, dw, dh, False);
 #endif
     } else {
-        XPutImage(d, w, FWi_x.gc, FWi_x.ximage, 0, 0, 0, 0, dw, dh);
+        XPutImage(d, wnd, FWi_x.gc, FWi_x.ximage, 0, 0, 0, 0, dw, dh);
     }
 }
 
+extern void
+vid_blit(void)
+{
+    vid_blitsub(FW_curinfo.width, FW_curinfo.height);
+}
+
 extern void
 vid_sync(void)
 {
@@ -616,6 +676,24 @@ wnd_osm_handle(void)
     return ret;
 }
 
+extern void
+wnd_osm_wait(int ms)
+{
+    struct pollfd pfd;
+
+    if (FWi_x.display == NULL) {
+        return;
+    }
+    XFlush(FWi_x.display);
+    if (XPending(FWi_x.display)) {
+        return;
+    }
+    pfd.fd      = ConnectionNumber(FWi_x.display);
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    poll(&pfd, 1, ms);
+}
+
 static void
 close_xdisplay(void)
 {
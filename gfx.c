@@ -26,10 +26,24 @@ int  PL_vres;
 int  PL_hres_h;
 int  PL_vres_h;
 int  PL_polygon_count;
+int  PL_interlace = PL_ILACE_OFF;
+int  PL_field     = 0;
+int  PL_guard_band = 1;
+int  PL_guard_band_count = 0;
+int  PL_probe     = 0;
 
 int *PL_video_buffer = NULL;
 int *PL_depth_buffer = NULL;
 
+/* video memory given to PL_init */
+static int *vid_out = NULL;
+
+/* frame signatures, see PL_probe_begin */
+static unsigned probe_sig;
+static unsigned shown_sig;
+static int shown_valid = 0;
+static int probe_settle; /* frames to draw after the last change */
+
 #define ZP           15      /* z precision */
 
 #define TXSH         PL_REQ_TEX_LOG_DIM
@@ -52,37 +66,91 @@ int *PL_depth_buffer = NULL;
 #define SCANP        18
 #define SCANP_ROUND  (1 << (SCANP - 1))
 
+#if PL_TILE_LOG
+#define TDIM         (1 << PL_TILE_LOG)
+#define TMSK         (TDIM - 1)
+/* distance from the end of a tile row to the start of the next tile's row */
+#define TSKIP        ((TDIM * TDIM) - TDIM)
+/* buffer offset of pixel (x, y) */
+#define POFS(x, y)   ((((y) >> PL_TILE_LOG) * tile_pitch) +      \
+                      (((x) & ~TMSK) << PL_TILE_LOG) +           \
+                      (((y) & TMSK) << PL_TILE_LOG) + ((x) & TMSK))
+/* step x, moving the pointers over to the next tile when crossing one */
+#define TSTEP(x, a, b) if (!(++(x) & TMSK)) { (a) += TSKIP; (b) += TSKIP; }
+
+static int tile_pitch; /* integers per row of tiles */
+#else
+#define POFS(x, y)   ((y) * PL_hres + (x))
+#define TSTEP(x, a, b)
+#endif
+
 static int scan_miny;
 static int scan_maxy;
+static int scan_gb; /* spans of the last scan need clipping to viewport */
+
+/* how far past the viewport edges the guard band reaches. scanning the
+ * part outside the viewport costs more than clipping it once it gets
+ * large, and (x << SCANP) must not overflow */
+#define GB_PAD       256
+/* largest coordinate or extent whose (x << SCANP) still fits an int */
+#define GB_LIM       (INT_MAX >> SCANP)
 
-/* integer reserve for data locality */
-static int g3dresv[PL_MAX_SCREENSIZE /* x_L */
-                 + PL_MAX_SCREENSIZE /* x_R */
-                 + PL_MAX_SCREENSIZE /* xLc */
-                 + PL_MAX_SCREENSIZE /* xRc */
-                 + (ATTRIBS * PL_MAX_SCREENSIZE) /* attrbuf */
-                 ];
+/* integer reserve for data locality, one block holding (per scanline)
+ * x_L, x_R, xLc, xRc and then ATTRIBS entries of attrbuf */
+static int *g3dresv = NULL;
+static int g3dresv_rows = 0; /* scanlines the reserve has room for */
 
-#define G3R_OFFS_XL     (0)
-#define G3R_OFFS_XR     (G3R_OFFS_XL + PL_MAX_SCREENSIZE)
-#define G3R_OFFS_XLC    (G3R_OFFS_XR + PL_MAX_SCREENSIZE)
-#define G3R_OFFS_XLR    (G3R_OFFS_XLC + PL_MAX_SCREENSIZE)
-#define G3R_OFFS_ATTR   (G3R_OFFS_XLR + PL_MAX_SCREENSIZE)
+#define G3R_INTS(rows)  ((4 + ATTRIBS) * (rows))
 
-static int *x_L = g3dresv + G3R_OFFS_XL;
-static int *x_R = g3dresv + G3R_OFFS_XR;
-static int *attrbuf = g3dresv + G3R_OFFS_ATTR; /* attribute buffer */
+static int *x_L;
+static int *x_R;
+static int *attrbuf; /* attribute buffer */
 
 /* cleared versions of scan conversion L/R buffers */
-static int *xLc = g3dresv + G3R_OFFS_XLC;
-static int *xRc = g3dresv + G3R_OFFS_XLR;
+static int *xLc;
+static int *xRc;
 
 static unsigned char mul8[256][256];
 
-extern void
-PL_init(int *video, int hres, int vres)
+/* number of pixels the PL owned buffers have room for */
+static int buf_cap = 0;
+
+/* size the scan conversion tables for vres scanlines */
+static void
+set_rows(int vres)
 {
-    int i, j;
+    int i;
+
+	if (vres > g3dresv_rows) {
+	    if (g3dresv) {
+	        EXT_free(g3dresv);
+	        g3dresv = NULL;
+	    }
+	    g3dresv = EXT_calloc(G3R_INTS(vres), sizeof(int));
+	    if (g3dresv == NULL) {
+	        EXT_error(PL_ERR_NO_MEM, "gfx", "no memory");
+	    }
+	    g3dresv_rows = vres;
+	}
+
+	/* set buffer offsets */
+    x_L = g3dresv;
+    x_R = x_L + vres;
+    xLc = x_R + vres;
+    xRc = xLc + vres;
+    attrbuf = xRc + vres;
+
+	for (i = 0; i < vres; i++) {
+        xLc[i] = INT_MAX;
+        xRc[i] = INT_MIN;
+    }
+}
+
+/* point PL at a render target, growing the buffers when needed */
+static void
+set_target(int *video, int hres, int vres)
+{
+    int bw, bh; /* buffer dimensions */
     
 	PL_hres   = hres;
 	PL_vres   = vres;
@@ -90,17 +158,63 @@ PL_init(int *video, int hres, int vres)
 	PL_vres_h = PL_vres >> 1;
 	PL_set_viewport(0, 0, PL_hres - 1, PL_vres - 1, 1);
 	
-	if (PL_depth_buffer) {
-	    EXT_free(PL_depth_buffer);
-		PL_depth_buffer = NULL;
+#if PL_TILE_LOG
+	/* pad the buffers out to whole tiles */
+	bw = (hres + TMSK) & ~TMSK;
+	bh = (vres + TMSK) & ~TMSK;
+	tile_pitch = bw << PL_TILE_LOG;
+#else
+	bw = hres;
+	bh = vres;
+	PL_video_buffer = video;
+#endif
+	if (hres > PL_MAX_SCREENSIZE || vres > PL_MAX_SCREENSIZE) {
+	    EXT_error(PL_ERR_MISC, "gfx", "resolution too large");
 	}
-
-	PL_depth_buffer = EXT_calloc(PL_hres * PL_vres, sizeof(int));
-	if (PL_depth_buffer == NULL) {
-	    EXT_error(PL_ERR_NO_MEM, "gfx", "no memory");
+	if ((bw * bh) > buf_cap) {
+	    if (PL_depth_buffer) {
+	        EXT_free(PL_depth_buffer);
+	        PL_depth_buffer = NULL;
+	    }
+	    PL_depth_buffer = EXT_calloc(bw * bh, sizeof(int));
+	    if (PL_depth_buffer == NULL) {
+	        EXT_error(PL_ERR_NO_MEM, "gfx", "no memory");
+	    }
+#if PL_TILE_LOG
+	    if (PL_video_buffer) {
+	        EXT_free(PL_video_buffer);
+	        PL_video_buffer = NULL;
+	    }
+	    PL_video_buffer = EXT_calloc(bw * bh, sizeof(int));
+	    if (PL_video_buffer == NULL) {
+	        EXT_error(PL_ERR_NO_MEM, "gfx", "no memory");
+	    }
+#endif
+	    buf_cap = bw * bh;
 	}
-	
-	PL_video_buffer = video;
+	vid_out = video;
+	set_rows(vres);
+}
+
+/* dynamic resolution state */
+static int dr_hres;   /* full resolution given to PL_init */
+static int dr_vres;
+static int dr_target; /* frame time budget in ms, 0 = disabled */
+static int dr_min;    /* smallest allowed scale */
+static int dr_scale;  /* current scale in 1/PL_DR_STEPS of full resolution */
+static int dr_avg;    /* smoothed frame time in 1/16 ms */
+static int dr_wait;   /* frames until the next change is allowed */
+
+extern void
+PL_init(int *video, int hres, int vres)
+{
+    int i, j;
+
+    set_target(video, hres, vres);
+    dr_hres   = hres;
+    dr_vres   = vres;
+    dr_scale  = PL_DR_STEPS;
+    dr_target = 0;
 	
     /* 8-bit * 8-bit number multiplication table */
 	for (i = 0; i < 256; i++) {
@@ -108,17 +222,6 @@ PL_init(int *video, int hres, int vres)
             mul8[i][j] = (unsigned char) ((i * j) >> 8);
         }
 	}
-
-	/* set buffer offsets */
-    x_L = g3dresv;
-    x_R = x_L + vres;
-    xLc = x_R + vres;
-    xRc = xLc + vres;
-
-	for (i = 0; i < vres; i++) {
-        xLc[i] = INT_MAX;
-        xRc[i] = INT_MIN;
-    }
 	
     /* sine is mirrored over X after PI */
     for (i = 0; i < (PL_TRIGMAX >> 1); i++) {
@@ -133,6 +236,84 @@ PL_init(int *video, int hres, int vres)
     }
 }
 
+/* resize the render target to the current scale */
+static void
+dr_apply(void)
+{
+    int w, h;
+
+    w = (dr_hres * dr_scale) / PL_DR_STEPS;
+    h = (dr_vres * dr_scale) / PL_DR_STEPS;
+    if (w < 16) {
+        w = 16;
+    }
+    if (h < 16) {
+        h = 16;
+    }
+    set_target(vid_out, w, h);
+    /* the old image doesn't fit the new size, don't let it show through */
+    memset(PL_video_buffer, 0, buf_cap * sizeof(int));
+    memset(PL_depth_buffer, 0, buf_cap * sizeof(int));
+}
+
+extern void
+PL_dynres(int target_ms, int min_scale)
+{
+    if (min_scale < 1) {
+        min_scale = 1;
+    }
+    if (min_scale > PL_DR_STEPS) {
+        min_scale = PL_DR_STEPS;
+    }
+    dr_target = target_ms > 0 ? target_ms : 0;
+    dr_min    = min_scale;
+    dr_avg    = dr_target << 4;
+    dr_wait   = 0;
+    if (!dr_target && dr_scale != PL_DR_STEPS) {
+        dr_scale = PL_DR_STEPS;
+        dr_apply();
+    }
+}
+
+extern int
+PL_dynres_frame(int frame_ms)
+{
+    int step;
+
+    if (!dr_target) {
+        return 0;
+    }
+    /* exponential moving average, 1/4 weight for the new sample */
+    dr_avg += ((frame_ms << 4) - dr_avg) >> 2;
+    if (dr_wait > 0) {
+        dr_wait--;
+        return 0;
+    }
+    step = 0;
+    if (dr_avg > (dr_target * 24)) {
+        step = -2; /* far over budget */
+    } else if (dr_avg > (dr_target * 17)) {
+        step = -1;
+    } else if (dr_avg < (dr_target * 12)) {
+        step = 1;  /* well under budget, the band in between is hysteresis */
+    }
+    step += dr_scale;
+    if (step < dr_min) {
+        step = dr_min;
+    }
+    if (step > PL_DR_STEPS) {
+        step = PL_DR_STEPS;
+    }
+    if (step == dr_scale) {
+        return 0;
+    }
+    dr_scale = step;
+    dr_apply();
+    /* let the average settle at the new size */
+    dr_wait = 4;
+    return 1;
+}
+
 static int
 packrgb(int r, int g, int b)
 {
@@ -151,33 +332,455 @@ PL_clear_vp(int r, int g, int b)
 	PL_clear_depth_vp();
 }
 
+/* first scanline at or after y that belongs to the field being rendered */
+static int
+field_row(int y)
+{
+    if (PL_interlace && ((y & 1) != PL_field)) {
+        y++;
+    }
+    return y;
+}
+
+/* while probing, clears only fold their buffer, value and area */
+static void
+probe_vp(int which, int val)
+{
+    int st[6];
+
+    st[0] = which;
+    st[1] = val;
+    st[2] = PL_vp_min_x;
+    st[3] = PL_vp_min_y;
+    st[4] = PL_vp_max_x;
+    st[5] = PL_vp_max_y;
+    PL_probe_fold(st, 6);
+}
+
+/* fill the viewport area of a color or depth buffer */
+static void
+fill_vp(int *buf, int val)
+{
+    int y, len, ystep;
+    int *p;
+#if PL_TILE_LOG
+    int x, *q;
+#endif
+
+    if (PL_probe) {
+        probe_vp(buf == PL_depth_buffer, val);
+        return;
+    }
+    ystep = PL_interlace ? 2 : 1;
+#if PL_TILE_LOG
+    for (y = field_row(PL_vp_min_y); y <= PL_vp_max_y; y += ystep) {
+        x = PL_vp_min_x;
+        while (x <= PL_vp_max_x) {
+            /* run until the end of the tile or the viewport */
+            len = TDIM - (x & TMSK);
+            if (len > (PL_vp_max_x - x + 1)) {
+                len = PL_vp_max_x - x + 1;
+            }
+            p = buf + POFS(x, y);
+            q = p + len;
+            while (p < q) {
+                *p++ = val;
+            }
+            x += len;
+        }
+    }
+#else
+    for (y = field_row(PL_vp_min_y); y <= PL_vp_max_y; y += ystep) {
+        p = buf + POFS(PL_vp_min_x, y);
+        len = PL_vp_max_x - PL_vp_min_x;
+        do {
+            *p++ = val;
+        } while (len--);
+    }
+#endif
+}
+
 extern void
 PL_clear_color_vp(int r, int g, int b)
 {
-	int hc, x, y, yoff;
-	
-	hc = packrgb(r, g, b);
-	
-	for (y = PL_vp_min_y; y <= PL_vp_max_y; y++) {
-        yoff = y * PL_hres;
-        for (x = PL_vp_min_x; x <= PL_vp_max_x; x++) {
-            PL_video_buffer[x + yoff] = hc;
+	fill_vp(PL_video_buffer, packrgb(r, g, b));
+}
+
+extern void
+PL_clear_depth_vp(void)
+{
+	fill_vp(PL_depth_buffer, 0);
+}
+
+/* copy the viewport area between two buffers laid out like the
+ * color and depth buffers */
+static void
+copy_vp(int *dst, int *src)
+{
+    int y, len, ystep, ofs;
+#if PL_TILE_LOG
+    int x;
+#endif
+
+    ystep = PL_interlace ? 2 : 1;
+#if PL_TILE_LOG
+    for (y = field_row(PL_vp_min_y); y <= PL_vp_max_y; y += ystep) {
+        x = PL_vp_min_x;
+        while (x <= PL_vp_max_x) {
+            len = TDIM - (x & TMSK);
+            if (len > (PL_vp_max_x - x + 1)) {
+                len = PL_vp_max_x - x + 1;
+            }
+            ofs = POFS(x, y);
+            memcpy(dst + ofs, src + ofs, len * sizeof(int));
+            x += len;
         }
     }
+#else
+    len = PL_vp_max_x - PL_vp_min_x + 1;
+    for (y = field_row(PL_vp_min_y); y <= PL_vp_max_y; y += ystep) {
+        ofs = POFS(PL_vp_min_x, y);
+        memcpy(dst + ofs, src + ofs, len * sizeof(int));
+    }
+#endif
+}
+
+/* static layer, see PL_layer_save */
+#define LAYER_KEY    29
+static int *layer_color = NULL;
+static int *layer_depth = NULL;
+static int layer_cap = 0;
+static int layer_fields = 0; /* one bit per field that was saved */
+static int layer_key[LAYER_KEY];
+
+/* everything that decides where static geometry lands in the buffers */
+static void
+layer_state(int *k)
+{
+    PL_get_camera_mat(k);
+    k[16] = PL_fov;
+    k[17] = PL_vp_min_x;
+    k[18] = PL_vp_min_y;
+    k[19] = PL_vp_max_x;
+    k[20] = PL_vp_max_y;
+    k[21] = PL_vp_cen_x;
+    k[22] = PL_vp_cen_y;
+    k[23] = PL_hres;
+    k[24] = PL_vres;
+    k[25] = PL_interlace;
+    k[26] = PL_raster_mode;
+    k[27] = PL_cull_mode;
+    k[28] = (int) (size_t) PL_cur_tex;
+}
+
+/* the scanlines a clear would touch */
+static int
+layer_bits(void)
+{
+    return PL_interlace ? (1 << PL_field) : 3;
 }
 
 extern void
-PL_clear_depth_vp(void)
+PL_layer_save(void)
+{
+    int k[LAYER_KEY];
+
+    if (PL_probe) {
+        return;
+    }
+    if (layer_cap < buf_cap) {
+        if (layer_color) {
+            EXT_free(layer_color);
+            EXT_free(layer_depth);
+        }
+        layer_cap = 0;
+        layer_fields = 0;
+        layer_color = EXT_calloc(buf_cap, sizeof(int));
+        layer_depth = EXT_calloc(buf_cap, sizeof(int));
+        if (layer_color == NULL || layer_depth == NULL) {
+            EXT_error(PL_ERR_NO_MEM, "gfx", "no memory");
+            return;
+        }
+        layer_cap = buf_cap;
+    }
+    layer_state(k);
+    if (memcmp(k, layer_key, sizeof(k)) != 0) {
+        memcpy(layer_key, k, sizeof(k));
+        layer_fields = 0;
+    }
+    copy_vp(layer_color, PL_video_buffer);
+    copy_vp(layer_depth, PL_depth_buffer);
+    layer_fields |= layer_bits();
+}
+
+extern int
+PL_layer_restore(void)
+{
+    int k[LAYER_KEY];
+    int bits;
+
+    bits = layer_bits();
+    if (PL_probe || (layer_fields & bits) != bits) {
+        return 0;
+    }
+    layer_state(k);
+    if (memcmp(k, layer_key, sizeof(k)) != 0) {
+        layer_fields = 0;
+        return 0;
+    }
+    copy_vp(PL_video_buffer, layer_color);
+    copy_vp(PL_depth_buffer, layer_depth);
+    return 1;
+}
+
+extern void
+PL_layer_invalidate(void)
+{
+    layer_fields = 0;
+}
+
+/* blend the scanlines left over from the previous frame with the fresh
+ * ones around them to hide the combing on moving edges */
+static void
+blend_field(int *img)
+{
+    int x, y, n;
+    int *p, *u, *d;
+
+    y = PL_vp_min_y + ((PL_vp_min_y & 1) == PL_field);
+    n = PL_vp_max_x - PL_vp_min_x;
+    for (; y <= PL_vp_max_y; y += 2) {
+        p = img + (y * PL_hres) + PL_vp_min_x;
+        u = (y > PL_vp_min_y) ? (p - PL_hres) : (p + PL_hres);
+        d = (y < PL_vp_max_y) ? (p + PL_hres) : u;
+        for (x = 0; x <= n; x++) {
+            p[x] = ((p[x] >> 1) & 0x7f7f7f) +
+                   ((u[x] >> 2) & 0x3f3f3f) +
+                   ((d[x] >> 2) & 0x3f3f3f);
+        }
+    }
+}
+
+#if PL_TILE_LOG
+/* copy each tile row by row into the linear video memory */
+static void
+untile(void)
 {
-	int x, y, yoff;
-	    
-    for (y = PL_vp_min_y; y <= PL_vp_max_y; y++) {
-        yoff = y * PL_hres;
-        for (x = PL_vp_min_x; x <= PL_vp_max_x; x++) {
-            PL_depth_buffer[x + yoff] = 0;
+    int tx, ty, y, w, h;
+    int *src, *dst;
+
+    for (ty = 0; ty < PL_vres; ty += TDIM) {
+        h = PL_vres - ty;
+        if (h > TDIM) {
+            h = TDIM;
+        }
+        src = PL_video_buffer + POFS(0, ty);
+        for (tx = 0; tx < PL_hres; tx += TDIM) {
+            w = PL_hres - tx;
+            if (w > TDIM) {
+                w = TDIM;
+            }
+            dst = vid_out + (ty * PL_hres) + tx;
+            for (y = 0; y < h; y++) {
+                memcpy(dst, src + (y << PL_TILE_LOG), w * sizeof(int));
+                dst += PL_hres;
+            }
+            src += TDIM * TDIM;
         }
     }
 }
+#endif
+
+extern void
+PL_present(void)
+{
+#if PL_TILE_LOG
+    untile();
+#endif
+    if (PL_interlace) {
+        if (PL_interlace == PL_ILACE_BLEND && PL_vp_min_y < PL_vp_max_y) {
+            blend_field(vid_out);
+        }
+        PL_field ^= 1;
+    }
+}
+
+/* the screen while rendering to a texture */
+static struct {
+    int *video;
+    int *depth;
+    int *out;
+    int  hres;
+    int  vres;
+    int  pitch;
+    int  vp[6];
+    int  interlace;
+} scr;
+static struct PL_TEX *tgt_tex = NULL;
+static int *tex_depth = NULL;
+#if PL_TILE_LOG
+static int *tex_color = NULL;
+#endif
+
+static void
+enter_tex(struct PL_TEX *tex)
+{
+    if (tex_depth == NULL) {
+        tex_depth = EXT_calloc(PL_REQ_TEX_DIM * PL_REQ_TEX_DIM, sizeof(int));
+#if PL_TILE_LOG
+        tex_color = EXT_calloc(PL_REQ_TEX_DIM * PL_REQ_TEX_DIM, sizeof(int));
+        if (tex_depth == NULL || tex_color == NULL) {
+            if (tex_depth) {
+                EXT_free(tex_depth);
+            }
+            if (tex_color) {
+                EXT_free(tex_color);
+            }
+            tex_depth = NULL;
+            tex_color = NULL;
+            EXT_error(PL_ERR_NO_MEM, "gfx", "no memory");
+            return;
+        }
+#else
+        if (tex_depth == NULL) {
+            EXT_error(PL_ERR_NO_MEM, "gfx", "no memory");
+            return;
+        }
+#endif
+    }
+    scr.video = PL_video_buffer;
+    scr.depth = PL_depth_buffer;
+    scr.out   = vid_out;
+    scr.hres  = PL_hres;
+    scr.vres  = PL_vres;
+    scr.vp[0] = PL_vp_min_x;
+    scr.vp[1] = PL_vp_min_y;
+    scr.vp[2] = PL_vp_max_x;
+    scr.vp[3] = PL_vp_max_y;
+    scr.vp[4] = PL_vp_cen_x;
+    scr.vp[5] = PL_vp_cen_y;
+    scr.interlace = PL_interlace;
+#if PL_TILE_LOG
+    scr.pitch  = tile_pitch;
+    tile_pitch = PL_REQ_TEX_DIM << PL_TILE_LOG;
+    PL_video_buffer = tex_color;
+#else
+    PL_video_buffer = tex->data;
+#endif
+    PL_depth_buffer = tex_depth;
+    vid_out = tex->data;
+    PL_hres = PL_REQ_TEX_DIM;
+    PL_vres = PL_REQ_TEX_DIM;
+    PL_hres_h = PL_hres >> 1;
+    PL_vres_h = PL_vres >> 1;
+    PL_interlace = PL_ILACE_OFF;
+    PL_set_viewport(0, 0, PL_hres - 1, PL_vres - 1, 1);
+    set_rows(PL_vres);
+    tgt_tex = tex;
+}
+
+static void
+leave_tex(void)
+{
+#if PL_TILE_LOG
+    untile();
+    tile_pitch = scr.pitch;
+#endif
+    PL_video_buffer = scr.video;
+    PL_depth_buffer = scr.depth;
+    vid_out = scr.out;
+    PL_hres = scr.hres;
+    PL_vres = scr.vres;
+    PL_hres_h = PL_hres >> 1;
+    PL_vres_h = PL_vres >> 1;
+    PL_interlace = scr.interlace;
+    PL_vp_min_x = scr.vp[0];
+    PL_vp_min_y = scr.vp[1];
+    PL_vp_max_x = scr.vp[2];
+    PL_vp_max_y = scr.vp[3];
+    PL_vp_cen_x = scr.vp[4];
+    PL_vp_cen_y = scr.vp[5];
+    set_rows(PL_vres);
+    tgt_tex = NULL;
+}
+
+extern void
+PL_target_tex(struct PL_TEX *tex)
+{
+    if (tgt_tex) {
+        leave_tex();
+    }
+    if (tex && tex->data) {
+        enter_tex(tex);
+    }
+}
+
+extern void
+PL_probe_begin(void)
+{
+    int st[3];
+
+    PL_probe  = 1;
+    probe_sig = 2166136261u;
+    st[0] = PL_hres;
+    st[1] = PL_vres;
+    st[2] = PL_interlace;
+    PL_probe_fold(st, 3);
+}
+
+extern int
+PL_probe_end(void)
+{
+    PL_probe = 0;
+    if (!shown_valid || probe_sig != shown_sig) {
+        shown_sig   = probe_sig;
+        shown_valid = 1;
+        /* interlaced, the other field still holds the frame before */
+        probe_settle = (PL_interlace != PL_ILACE_OFF);
+        return 1;
+    }
+    if (probe_settle > 0) {
+        probe_settle--;
+        return 1;
+    }
+    return 0;
+}
+
+extern void
+PL_probe_fold(int *v, int n)
+{
+    unsigned h;
+
+    h = probe_sig;
+    while (n-- > 0) {
+        h = (h ^ (unsigned) *v++) * 16777619u;
+        h ^= h >> 15;
+    }
+    probe_sig = h;
+}
+
+/* returns nonzero if the polygon fits the guard band around the
+ * viewport, it can then be scanned without clipping */
+static int
+guard_band(int *stream, int dim, int len)
+{
+    int minx = INT_MAX, maxx = INT_MIN;
+    int miny = INT_MAX, maxy = INT_MIN;
+
+    while (len--) {
+        if (stream[0] < minx) { minx = stream[0]; }
+        if (stream[0] > maxx) { maxx = stream[0]; }
+        if (stream[1] < miny) { miny = stream[1]; }
+        if (stream[1] > maxy) { maxy = stream[1]; }
+        stream += dim;
+    }
+    /* near PL_MAX_SCREENSIZE the band is cut short so the unclipped
+     * coordinates and their deltas never overflow the fixed point */
+    return minx > (PL_vp_min_x - GB_PAD) && maxx < (PL_vp_max_x + GB_PAD) &&
+           miny > (PL_vp_min_y - GB_PAD) && maxy < (PL_vp_max_y + GB_PAD) &&
+           maxx < GB_LIM && maxy < GB_LIM &&
+           (maxx - minx) < GB_LIM && (maxy - miny) < GB_LIM;
+}
 
 /* scan convert polygon */
 static int
@@ -190,6 +793,7 @@ pscan(int *stream, int dim, int len)
     int x, y, dx, dy;
     int mjr, ady;
     int sx, sy, i;
+    int noclip;
     int *AS; /* attribute buffer ptr */
     int *AT = resv + (0 * PL_VDIM); /* vertex attributes */
     int *DT = resv + (1 * PL_VDIM); /* delta vertex attributes */
@@ -204,11 +808,29 @@ pscan(int *stream, int dim, int len)
     memcpy(x_L, xLc, PL_vres * sizeof(int));
     memcpy(x_R, xRc, PL_vres * sizeof(int));
   
-    len = PL_clip_poly_x(VS, stream, dim, len);
+    scan_gb = 0;
+    if (!(len & PL_NOCLIP) && PL_guard_band && guard_band(stream, dim, len)) {
+        PL_guard_band_count++;
+        len |= PL_NOCLIP;
+        scan_gb = 1;
+    }
+    if (len & PL_NOCLIP) {
+        /* already known to be inside the viewport. start from the
+         * second vertex like the clipper's output does, the order
+         * decides which edge wins on shared scanline ends */
+        len &= ~PL_NOCLIP;
+        memcpy(VS, stream + dim, len * dim * sizeof(int));
+        memcpy(VS + len * dim, stream + dim, dim * sizeof(int));
+        noclip = 1;
+    } else {
+        len = PL_clip_poly_x(VS, stream, dim, len);
+        noclip = 0;
+    }
     while (len--) {
         vA = VS;
         vB = VS += dim;
-        if (!PL_clip_line_y(&vA, &vB, dim, PL_vp_min_y, PL_vp_max_y)) {
+        if (!noclip &&
+            !PL_clip_line_y(&vA, &vB, dim, PL_vp_min_y, PL_vp_max_y)) {
             continue;
         }
         x  = *vA++;
@@ -219,6 +841,10 @@ pscan(int *stream, int dim, int len)
         if (y  > scan_maxy) { scan_maxy = y; }
         if (dy < scan_miny) { scan_miny = dy;}
         if (dy > scan_maxy) { scan_maxy = dy;}
+        if (scan_gb && ((y < PL_vp_min_y && dy < PL_vp_min_y) ||
+                        (y > PL_vp_max_y && dy > PL_vp_max_y))) {
+            continue; /* edge is entirely above or below the viewport */
+        }
         dx -= x;
         dy -= y;
         mjr = dx;
@@ -244,21 +870,41 @@ pscan(int *stream, int dim, int len)
         y  = (y  << SCANP) + SCANP_ROUND;
         dx = (dx << SCANP) / mjr;
         dy = (dy << SCANP) / mjr;
+        if (PL_interlace && (ady == mjr)) {
+            /* one row per step, only visit the rows of this field */
+            if (((y >> SCANP) & 1) != PL_field) {
+                x += dx;
+                y += dy;
+                for (i = 0; i < rdim; i++) {
+                    AT[i] += DT[i];
+                }
+                mjr--;
+            }
+            dx += dx;
+            dy += dy;
+            for (i = 0; i < rdim; i++) {
+                DT[i] += DT[i];
+            }
+            mjr >>= 1;
+        }
         do {
             sx = x >> SCANP;
             sy = y >> SCANP;
-            if (x_L[sy] > sx) {
-                x_L[sy] = sx;
-                AS = ABL + YT(sy);
-                for (i = 0; i < rdim; i++) {
-                    AS[i << 1] = AT[i];
+            /* rows outside the viewport only happen in the guard band */
+            if (sy >= PL_vp_min_y && sy <= PL_vp_max_y) {
+                if (x_L[sy] > sx) {
+                    x_L[sy] = sx;
+                    AS = ABL + YT(sy);
+                    for (i = 0; i < rdim; i++) {
+                        AS[i << 1] = AT[i];
+                    }
                 }
-            }
-            if (x_R[sy] < sx) {
-                x_R[sy] = sx;
-                AS = ABR + YT(sy);
-                for (i = 0; i < rdim; i++) {
-                    AS[i << 1] = AT[i];
+                if (x_R[sy] < sx) {
+                    x_R[sy] = sx;
+                    AS = ABR + YT(sy);
+                    for (i = 0; i < rdim; i++) {
+                        AS[i << 1] = AT[i];
+                    }
                 }
             }
             x += dx;
@@ -268,14 +914,36 @@ pscan(int *stream, int dim, int len)
             }
         } while (mjr--);
     }
+    if (scan_gb) {
+        if (scan_miny < PL_vp_min_y) { scan_miny = PL_vp_min_y; }
+        if (scan_maxy > PL_vp_max_y) { scan_maxy = PL_vp_max_y; }
+    }
     return (scan_miny >= scan_maxy);
 }
 
+/* clip a span of the guard band to the viewport.
+ * returns the number of pixels cut off the left, -1 if nothing is left */
+static int
+gb_span(int *beg, int *len)
+{
+    int skip = 0;
+
+    if (*beg < PL_vp_min_x) {
+        skip = PL_vp_min_x - *beg;
+        *beg = PL_vp_min_x;
+        *len -= skip;
+    }
+    if ((*beg + *len) > PL_vp_max_x) {
+        *len = PL_vp_max_x - *beg;
+    }
+    return (*len < 0) ? -1 : skip;
+}
+
 extern void
 PL_flat_poly(int *stream, int len, int rgb)
 {
-    int miny, maxy;
-    int pos, beg, pbg;
+    int miny, maxy, ystep;
+    int beg, pbg;
     register int *vbuf, *zbuf;
     int d, yt, dz, sz, dlen;
     int r8 = rgb >> 16 & 0xff;
@@ -285,19 +953,27 @@ PL_flat_poly(int *stream, int len, int rgb)
     if (pscan(stream, PL_STREAM_FLAT, len)) {
         return;
     }
-    miny = scan_miny;
+    miny = field_row(scan_miny);
     maxy = scan_maxy;
-    pos = miny * PL_hres;
+    ystep = PL_interlace ? 2 : 1;
     while (miny <= maxy) {
         beg  = x_L[miny];
-        pbg  = pos + beg;
-        vbuf = PL_video_buffer + pbg;
-        zbuf = PL_depth_buffer + pbg;
         len  = x_R[miny] - beg;
         dlen = len + (len == 0);
         yt   = YT(miny);
         sz   =  attrbuf[ZL(yt)];
         dz   = (attrbuf[ZR(yt)] - sz) / dlen;
+        if (scan_gb) {
+            d = gb_span(&beg, &len);
+            if (d < 0) {
+                miny += ystep;
+                continue;
+            }
+            sz += dz * d;
+        }
+        pbg  = POFS(beg, miny);
+        vbuf = PL_video_buffer + pbg;
+        zbuf = PL_depth_buffer + pbg;
 
         do {
             if (*zbuf < sz) {
@@ -312,10 +988,10 @@ PL_flat_poly(int *stream, int len, int rgb)
             sz += dz;
             vbuf++;
             zbuf++;
+            TSTEP(beg, vbuf, zbuf);
         } while (len--);
         /* next scanline */
-        miny++;
-        pos += PL_hres;
+        miny += ystep;
     }
     PL_polygon_count++;
 }
@@ -323,8 +999,8 @@ PL_flat_poly(int *stream, int len, int rgb)
 extern void
 PL_lintx_poly(int *stream, int len, int *texels)
 {
-    int miny, maxy;
-    int pos, beg, pbg;
+    int miny, maxy, ystep;
+    int beg, pbg;
     int *vbuf, *zbuf;
     int yt;
     int du = 0, dv = 0, dz;
@@ -334,14 +1010,11 @@ PL_lintx_poly(int *stream, int len, int *texels)
     if (pscan(stream, PL_STREAM_TEX, len)) {
         return;
     }
-    miny = scan_miny;
+    miny = field_row(scan_miny);
     maxy = scan_maxy;
-    pos = miny * PL_hres;
+    ystep = PL_interlace ? 2 : 1;
     while (miny <= maxy) {
         beg  = x_L[miny];
-        pbg  = pos + beg;
-        vbuf = PL_video_buffer + pbg;
-        zbuf = PL_depth_buffer + pbg;
         len  = x_R[miny] - beg;
         dlen = len + (len == 0);
         yt   = YT(miny);
@@ -351,6 +1024,19 @@ PL_lintx_poly(int *stream, int len, int *texels)
         du   = (attrbuf[UR(yt)] - su) / dlen;
         sv   =  attrbuf[VL(yt)];
         dv   = (attrbuf[VR(yt)] - sv) / dlen;
+        if (scan_gb) {
+            d = gb_span(&beg, &len);
+            if (d < 0) {
+                miny += ystep;
+                continue;
+            }
+            sz += dz * d;
+            su += du * d;
+            sv += dv * d;
+        }
+        pbg  = POFS(beg, miny);
+        vbuf = PL_video_buffer + pbg;
+        zbuf = PL_depth_buffer + pbg;
     
         while (len >= 0) {
             if (*zbuf < sz) {
@@ -376,11 +1062,299 @@ PL_lintx_poly(int *stream, int len, int *texels)
             sz += dz;
             vbuf++;
             zbuf++;
+            TSTEP(beg, vbuf, zbuf);
+            len--;
+        }
+        /* next scanline */
+        miny += ystep;
+    }
+    PL_polygon_count++;
+}
+
+extern void
+PL_keytx_poly(int *stream, int len, int *texels)
+{
+    int miny, maxy, ystep;
+    int beg, pbg;
+    int *vbuf, *zbuf;
+    int yt;
+    int du = 0, dv = 0, dz;
+    int su = 0, sv = 0, sz;
+    int d, dlen;
+
+    if (pscan(stream, PL_STREAM_TEX, len)) {
+        return;
+    }
+    miny = field_row(scan_miny);
+    maxy = scan_maxy;
+    ystep = PL_interlace ? 2 : 1;
+    while (miny <= maxy) {
+        beg  = x_L[miny];
+        len  = x_R[miny] - beg;
+        dlen = len + (len == 0);
+        yt   = YT(miny);
+        sz   =  attrbuf[ZL(yt)];
+        dz   = (attrbuf[ZR(yt)] - sz) / dlen;
+        su   =  attrbuf[UL(yt)];
+        du   = (attrbuf[UR(yt)] - su) / dlen;
+        sv   =  attrbuf[VL(yt)];
+        dv   = (attrbuf[VR(yt)] - sv) / dlen;
+        if (scan_gb) {
+            d = gb_span(&beg, &len);
+            if (d < 0) {
+                miny += ystep;
+                continue;
+            }
+            sz += dz * d;
+            su += du * d;
+            sv += dv * d;
+        }
+        pbg  = POFS(beg, miny);
+        vbuf = PL_video_buffer + pbg;
+        zbuf = PL_depth_buffer + pbg;
+
+        while (len >= 0) {
+            if (*zbuf < sz) {
+                su &= TXMSK;
+                sv &= TXMSK;
+                yt = texels[(su >> PL_TP) | (sv >> PL_TP << TXSH)];
+                /* key colored texels are holes, depth stays as it was */
+                if (yt != PL_TEX_KEY) {
+                    *zbuf = sz;
+                    *vbuf = yt;
+                }
+            }
+            su += du;
+            sv += dv;
+            sz += dz;
+            vbuf++;
+            zbuf++;
+            TSTEP(beg, vbuf, zbuf);
+            len--;
+        }
+        /* next scanline */
+        miny += ystep;
+    }
+    PL_polygon_count++;
+}
+
+/* expand a R5G6B5 color to X8R8G8B8 */
+static int
+bc_expand(int c)
+{
+    int r, g, b;
+
+    r = (c >> 11) & 0x1f;
+    g = (c >>  5) & 0x3f;
+    b = (c >>  0) & 0x1f;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return (r << 16) | (g << 8) | b;
+}
+
+/* roughly (2a + b) / 3 for each channel of two X8R8G8B8 colors,
+ * red and blue are done together in one multiply */
+static int
+bc_lerp3(int a, int b)
+{
+    int rb, g;
+
+    rb = ((((a & 0xff00ff) << 1) + (b & 0xff00ff)) * 21) >> 6;
+    g  = ((((a & 0x00ff00) << 1) + (b & 0x00ff00)) * 21) >> 6;
+    return (rb & 0xff00ff) | (g & 0x00ff00);
+}
+
+/* decode the four colors of a block */
+static void
+bc_palette(int *pal, int ends)
+{
+    pal[0] = bc_expand(ends);
+    pal[1] = bc_expand(ends >> 16);
+    pal[2] = bc_lerp3(pal[0], pal[1]);
+    pal[3] = bc_lerp3(pal[1], pal[0]);
+}
+
+static int
+rgb_dist(int a, int b)
+{
+    int r, g, bl;
+
+    r  = ((a >> 16) & 0xff) - ((b >> 16) & 0xff);
+    g  = ((a >>  8) & 0xff) - ((b >>  8) & 0xff);
+    bl = ((a >>  0) & 0xff) - ((b >>  0) & 0xff);
+    return (r * r) + (g * g) + (bl * bl);
+}
+
+static int
+rgb_to_565(int c)
+{
+    return (((c >> 19) & 0x1f) << 11) |
+           (((c >> 10) & 0x3f) <<  5) |
+           (((c >>  3) & 0x1f) <<  0);
+}
+
+extern int
+PL_tex_compress(struct PL_TEX *tex)
+{
+    int blk[16], pal[4];
+    int bx, by, i, j, k;
+    int d, best, bestd;
+    int e0, e1;
+    unsigned idx;
+    int *out;
+
+    if (tex == NULL || tex->data == NULL) {
+        return 0;
+    }
+    if (tex->bc == NULL) {
+        tex->bc = EXT_calloc(PL_BC_BLOCKS * 2, sizeof(int));
+        if (tex->bc == NULL) {
+            EXT_error(PL_ERR_NO_MEM, "gfx", "no memory");
+            return 0;
+        }
+    }
+    out = tex->bc;
+    for (by = 0; by < PL_REQ_TEX_DIM; by += 4) {
+        for (bx = 0; bx < PL_REQ_TEX_DIM; bx += 4) {
+            for (i = 0; i < 4; i++) {
+                for (j = 0; j < 4; j++) {
+                    k = (bx + j) + ((by + i) << TXSH);
+                    blk[(i << 2) + j] = tex->data[k];
+                }
+            }
+            /* the two texels furthest apart become the endpoints */
+            e0 = 0;
+            e1 = 0;
+            bestd = -1;
+            for (i = 0; i < 16; i++) {
+                for (j = i + 1; j < 16; j++) {
+                    d = rgb_dist(blk[i], blk[j]);
+                    if (d > bestd) {
+                        bestd = d;
+                        e0 = i;
+                        e1 = j;
+                    }
+                }
+            }
+            e0 = rgb_to_565(blk[e0]);
+            e1 = rgb_to_565(blk[e1]);
+            out[0] = (int) (((unsigned) e1 << 16) | e0);
+            bc_palette(pal, out[0]);
+            /* pick the closest of the four decoded colors for each texel */
+            idx = 0;
+            for (i = 0; i < 16; i++) {
+                best = 0;
+                bestd = rgb_dist(blk[i], pal[0]);
+                for (j = 1; j < 4; j++) {
+                    d = rgb_dist(blk[i], pal[j]);
+                    if (d < bestd) {
+                        bestd = d;
+                        best = j;
+                    }
+                }
+                idx |= (unsigned) best << (i << 1);
+            }
+            out[1] = (int) idx;
+            out += 2;
+        }
+    }
+    return (PL_REQ_TEX_DIM * PL_REQ_TEX_DIM - PL_BC_BLOCKS * 2) * sizeof(int);
+}
+
+/* direct mapped cache of decoded blocks: 4 colors + the indices */
+#define BCC_SIZE     64
+#define BCC_MSK      (BCC_SIZE - 1)
+
+/* masks for the block column and row bits of a block index */
+#define BUMSK        ((1 << (TXSH - 2)) - 1)
+#define BVMSK        (BUMSK << (TXSH - 2))
+
+static int bcc_tag[BCC_SIZE];
+static int bcc_pal[BCC_SIZE][5];
+
+extern void
+PL_bctx_poly(int *stream, int len, int *blocks)
+{
+    int miny, maxy, ystep;
+    int beg, pbg;
+    int *vbuf, *zbuf;
+    int yt;
+    int du = 0, dv = 0, dz;
+    int su = 0, sv = 0, sz;
+    int r, d, dlen;
+    int *pal;
+
+    if (pscan(stream, PL_STREAM_TEX, len)) {
+        return;
+    }
+    for (d = 0; d < BCC_SIZE; d++) {
+        bcc_tag[d] = -1;
+    }
+    miny = field_row(scan_miny);
+    maxy = scan_maxy;
+    ystep = PL_interlace ? 2 : 1;
+    while (miny <= maxy) {
+        beg  = x_L[miny];
+        len  = x_R[miny] - beg;
+        dlen = len + (len == 0);
+        yt   = YT(miny);
+        sz   =  attrbuf[ZL(yt)];
+        dz   = (attrbuf[ZR(yt)] - sz) / dlen;
+        su   =  attrbuf[UL(yt)];
+        du   = (attrbuf[UR(yt)] - su) / dlen;
+        sv   =  attrbuf[VL(yt)];
+        dv   = (attrbuf[VR(yt)] - sv) / dlen;
+        if (scan_gb) {
+            d = gb_span(&beg, &len);
+            if (d < 0) {
+                miny += ystep;
+                continue;
+            }
+            sz += dz * d;
+            su += du * d;
+            sv += dv * d;
+        }
+        pbg  = POFS(beg, miny);
+        vbuf = PL_video_buffer + pbg;
+        zbuf = PL_depth_buffer + pbg;
+
+        while (len >= 0) {
+            if (*zbuf < sz) {
+                *zbuf = sz;
+                /* block index and bit position of the texel in it */
+                yt = ((sv >> (PL_TP + 4 - TXSH)) & BVMSK) |
+                     ((su >> (PL_TP + 2)) & BUMSK);
+                /* decoded blocks get reused by the neighboring
+                 * texels on this and the following scanlines */
+                pal = bcc_pal[yt & BCC_MSK];
+                if (bcc_tag[yt & BCC_MSK] != yt) {
+                    bcc_tag[yt & BCC_MSK] = yt;
+                    bc_palette(pal, blocks[yt << 1]);
+                    pal[4] = blocks[(yt << 1) + 1];
+                }
+                r  = ((sv >> (PL_TP - 3)) & 0x18) | ((su >> (PL_TP - 1)) & 6);
+                yt = pal[((unsigned) pal[4] >> r) & 3];
+                d = (sz >> 20) * 3 / 2;
+                if (d >= 256) {
+                    *vbuf = yt;
+                } else {
+                    r  = mul8[d][(yt >> 16) & 0xff] << 16;
+                    r |= mul8[d][(yt >>  8) & 0xff] <<  8;
+                    r |= mul8[d][(yt >>  0) & 0xff] <<  0;
+                    *vbuf = r;
+                }
+            }
+            su += du;
+            sv += dv;
+            sz += dz;
+            vbuf++;
+            zbuf++;
+            TSTEP(beg, vbuf, zbuf);
             len--;
         }
         /* next scanline */
-        miny++;
-        pos += PL_hres;
+        miny += ystep;
     }
     PL_polygon_count++;
 }
@@ -23,8 +23,11 @@
 static struct PL_OBJ product;
 static struct PL_OBJ working_copy;
 
-static int vertices[PL_MAX_OBJ_V];             /* temp storage for vertices */
-static struct PL_POLY polys[PL_MAX_OBJ_V / 4]; /* temp storage for polygons */
+/* temp storage, grown as needed */
+static int *vertices = NULL;         /* temp storage for vertices */
+static struct PL_POLY *polys = NULL; /* temp storage for polygons */
+static int vert_cap = 0;             /* vertices there is room for */
+static int poly_cap = 0;             /* polygons there is room for */
 
 static int polytype   = PL_TRIANGLES;
 static int n_vertices = 0;     /* entered so far */
@@ -65,6 +68,31 @@ clear_product(void)
 	product.n_polys = 0;
 }
 
+/* returns buf with room for more than n elements of size esz,
+ * doubling it and keeping its contents if needed */
+static void *
+grow(void *buf, int *cap, int n, int esz)
+{
+	void *nbuf;
+	int ncap;
+
+	if (n < *cap) {
+		return buf;
+	}
+	ncap = (*cap > 0) ? (*cap * 2) : 256;
+	nbuf = EXT_calloc(ncap, esz);
+	if (nbuf == NULL) {
+		EXT_error(PL_ERR_NO_MEM, "imode", "no memory");
+		return buf;
+	}
+	if (buf) {
+		memcpy(nbuf, buf, *cap * esz);
+		EXT_free(buf);
+	}
+	*cap = ncap;
+	return nbuf;
+}
+
 static int
 add_vertex(int x, int y, int z)
 {
@@ -77,6 +105,7 @@ add_vertex(int x, int y, int z)
 			return i;
 		}
 	}
+	vertices = grow(vertices, &vert_cap, n_vertices, PL_VLEN * sizeof(int));
 	vertices[n_vertices * PL_VLEN    ] = x;
 	vertices[n_vertices * PL_VLEN + 1] = y;
 	vertices[n_vertices * PL_VLEN + 2] = z;
@@ -91,6 +120,7 @@ add_polygon(void)
     int base;
     int edges;
 
+	polys = grow(polys, &poly_cap, n_polys, sizeof(struct PL_POLY));
 	tmp = &polys[n_polys];
 	memset(tmp, 0, sizeof(struct PL_POLY));
 	tmp->tex = curtex;
@@ -250,10 +280,32 @@ PL_iinit(void)
 	}
 }
 
+/* the working copy is rebuilt in place, its contents go into the
+ * frame signature as well */
+static void
+probe_copy(void)
+{
+	int i, st[3];
+	struct PL_POLY *p;
+
+	PL_probe_fold(working_copy.verts, working_copy.n_verts * PL_VLEN);
+	for (i = 0; i < working_copy.n_polys; i++) {
+		p = &working_copy.polys[i];
+		st[0] = (int) (size_t) p->tex;
+		st[1] = p->color;
+		st[2] = p->n_verts;
+		PL_probe_fold(st, 3);
+		PL_probe_fold(p->verts, ((p->n_verts & 0xf) + 1) * PL_POLY_VLEN);
+	}
+}
+
 extern void
 PL_irender(void)
 {
 	if (n_vertices && n_polys) {
+		if (PL_probe) {
+			probe_copy();
+		}
 		PL_render_object(&working_copy);
 	}
 }
@@ -294,6 +346,8 @@ PL_export(struct PL_OBJ *dest)
 		memcpy(&dest->polys[i], &product.polys[i], sizeof(struct PL_POLY));
 	}
 	dest->n_polys = product.n_polys;
+	PL_calc_bounds(dest);
+	PL_calc_planes(dest);
 }
 
 extern struct PL_OBJ *
@@ -111,6 +111,40 @@ import_dmdl(char *name, struct PL_OBJ **o)
 		read_polygon(out, &dst->polys[i]);
 	}
 	fclose(out);
+	PL_calc_bounds(dst);
+	PL_calc_planes(dst);
 
 	return 1;
 }
+
+extern int
+export_dmdl(char *name, struct PL_OBJ *o)
+{
+    struct PL_POLY *p;
+    FILE *out;
+    int i, j, nv;
+    int *dv;
+
+    snprintf(g_buf, sizeof(g_buf), "%s.dmdl", name);
+    if (!(out = fopen(g_buf, "wb"))) {
+        fprintf(stderr, "failed to write dmdl file: %s\n", g_buf);
+        return 0;
+    }
+    fprintf(out, "%d\n", o->n_verts);
+    for (i = 0; i < o->n_verts; i++) {
+        dv = o->verts + i * PL_VLEN;
+        fprintf(out, "%d %d %d 1\n", dv[0], dv[1], dv[2]);
+    }
+    fprintf(out, "%d\n", o->n_polys);
+    for (i = 0; i < o->n_polys; i++) {
+        p = &o->polys[i];
+        nv = p->n_verts & 0xf;
+        /* texture ID, color, then the color again for the editor */
+        fprintf(out, "0\n%d\n%d\n%d\n", p->color, p->color, nv);
+        for (j = 0; j <= nv; j++) {
+            dv = p->verts + j * PL_POLY_VLEN;
+            fprintf(out, "%d\n0\n%d\n%d\n", dv[0], dv[1], dv[2]);
+        }
+    }
+    return fclose(out) == 0;
+}
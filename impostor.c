@@ -0,0 +1,273 @@
+/*****************************************************************************/
+/*
+ * PiSHi LE (Lite edition) - Fundamentals of the King's Crook graphics engine.
+ *
+ *   by EMMIR 2018-2022
+ *
+ *   YouTube: https://www.youtube.com/c/LMP88
+ *
+ * This software is released into the public domain.
+ */
+/*****************************************************************************/
+
+#include "pl.h"
+
+/*  impostor.c
+ *
+ * Distant objects drawn as camera facing quads, textured with pictures
+ * of them rendered into a cache of textures.
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+/* how far the view may change before the picture is rendered again,
+ * 1/32 of the unit rotation or of the distance */
+#define TOL_SHIFT  5
+/* radius of the bounding sphere in the picture, leaves room for the
+ * perspective to stretch objects off to the side */
+#define TEX_R      (PL_REQ_TEX_DIM * 11 / 32)
+/* highest the fov is raised to zoom in on an object */
+#define MAX_FOV    16
+
+/* 3x3 of the model+view, view space center of the bounding sphere,
+ * fov, raster and cull mode, and the texture override */
+#define KEY_LEN    16
+
+struct IMP {
+    struct PL_OBJ *obj; /* NULL if the entry is free */
+    int id;
+    unsigned used; /* when it was drawn last, the oldest is reused */
+    int key[KEY_LEN];
+    int zoom; /* the fov was raised by this much for the picture */
+    int r; /* radius of the bounding sphere in the picture */
+    struct PL_TEX tex;
+};
+
+int PL_impostor_updates = 0;
+
+static struct IMP *imps = NULL;
+static int n_imps = 0;
+static unsigned imp_clock = 0;
+
+static void
+make_key(int *k, int *sph)
+{
+    int m[16];
+    int i, j;
+
+    PL_mst_get_mv(m);
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            k[i * 3 + j] = m[i * 4 + j];
+        }
+    }
+    k[9]  = sph[0];
+    k[10] = sph[1];
+    k[11] = sph[2];
+    k[12] = PL_fov;
+    k[13] = PL_raster_mode;
+    k[14] = PL_cull_mode;
+    k[15] = (int) (size_t) PL_cur_tex;
+}
+
+/* 1 if a picture taken under key k still passes for the view in key */
+static int
+fresh(int *k, int *key)
+{
+    int i, tol;
+
+    tol = PL_P_ONE >> TOL_SHIFT;
+    for (i = 0; i < 9; i++) {
+        if (abs(key[i] - k[i]) > tol) {
+            return 0;
+        }
+    }
+    tol = k[11] >> TOL_SHIFT;
+    for (i = 9; i < 12; i++) {
+        if (abs(key[i] - k[i]) > tol) {
+            return 0;
+        }
+    }
+    for (i = 12; i < KEY_LEN; i++) {
+        if (key[i] != k[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static struct IMP *
+find(struct PL_OBJ *obj, int id)
+{
+    struct IMP *e, *old;
+    int i;
+
+    old = imps;
+    for (i = 0; i < n_imps; i++) {
+        e = &imps[i];
+        if (e->obj == obj && e->id == id) {
+            return e;
+        }
+        if (e->obj == NULL) {
+            old = e;
+        } else if (old->obj != NULL && e->used < old->used) {
+            old = e;
+        }
+    }
+    /* not there, hand out a free or the least recently used entry */
+    old->obj = obj;
+    old->id  = id;
+    old->key[12] = -1; /* never fresh */
+    return old;
+}
+
+/* render the picture of obj, with sph its view space bounding sphere */
+static void
+update(struct IMP *e, struct PL_OBJ *obj, int *sph)
+{
+    int fov, z, f;
+
+    /* zoom in by raising the fov, the picture then matches the screen
+     * around the object pixel for pixel at a power of two scale */
+    fov = PL_fov;
+    z = 0;
+    while ((fov + z) < MAX_FOV &&
+           ((sph[3] << (fov + z + 1)) / sph[2]) <= TEX_R) {
+        z++;
+    }
+    PL_target_tex(&e->tex);
+    PL_fov = fov + z;
+    /* move the center of the projection so the object lands in the
+     * middle of the texture */
+    f = (1 << (PL_fov + 12)) / sph[2];
+    PL_vp_cen_x = PL_hres_h - ((sph[0] * f + (1 << 11)) >> 12);
+    PL_vp_cen_y = PL_vres_h + ((sph[1] * f + (1 << 11)) >> 12);
+    PL_clear_vp((PL_TEX_KEY >> 16) & 0xff,
+                (PL_TEX_KEY >>  8) & 0xff,
+                (PL_TEX_KEY >>  0) & 0xff);
+    PL_render_object(obj);
+    PL_fov = fov;
+    PL_target_tex(NULL);
+
+    e->zoom = z;
+    e->r = (sph[3] << (fov + z)) / sph[2];
+    PL_impostor_updates++;
+}
+
+/* draw the picture on a screen aligned quad over where obj is */
+static void
+draw(struct IMP *e, int *sph)
+{
+    int stream[5 * PL_STREAM_TEX];
+    int f, x, y, h, r, z, i;
+    int *v;
+
+    f = (1 << (PL_fov + 12)) / sph[2];
+    x = ((sph[0] * f + (1 << 11)) >> 12) + PL_vp_cen_x;
+    y = PL_vp_cen_y - ((sph[1] * f + (1 << 11)) >> 12);
+    /* half the texture on screen, following the distance */
+    r = (sph[3] << (PL_fov + e->zoom)) / sph[2];
+    h = ((PL_REQ_TEX_DIM / 2) * r) / (e->r + (e->r == 0));
+    h = (h + ((1 << e->zoom) >> 1)) >> e->zoom;
+    if (h <= 0) {
+        return;
+    }
+    /* depth of the front of the sphere so it doesn't sink into what
+     * it stands on, in the 1/Z format of PL_psp_project */
+    z = sph[2] - sph[3];
+    if (z < PL_Z_NEAR_PLANE) {
+        z = PL_Z_NEAR_PLANE;
+    }
+    z = ((1 << (PL_fov + 12)) / z) >> (PL_fov - 8);
+    for (i = 0; i < 5; i++) {
+        v = stream + i * PL_STREAM_TEX;
+        /* corners clockwise from the top left, back to the first */
+        v[0] = (((i + 1) & 2) ? (x + h) : (x - h));
+        v[1] = ((i & 2) ? (y + h) : (y - h));
+        v[2] = z;
+        v[3] = ((i + 1) & 2) ? ((PL_REQ_TEX_DIM << PL_TP) - 1) : 0;
+        v[4] = (i & 2) ? ((PL_REQ_TEX_DIM << PL_TP) - 1) : 0;
+    }
+    PL_keytx_poly(stream, 4, e->tex.data);
+}
+
+extern void
+PL_render_impostor(struct PL_OBJ *obj, int id, int px)
+{
+    int sph[4];
+    int key[KEY_LEN];
+    struct IMP *e;
+
+    if (!obj) {
+        return;
+    }
+    if (PL_probe || n_imps == 0 || obj->bsphere[3] <= 0) {
+        PL_render_object(obj);
+        return;
+    }
+    PL_mst_xf_sphere(obj->bsphere, sph);
+    if (PL_sphere_frustum_test(sph) == PL_VIS_OUTSIDE) {
+        return;
+    }
+    /* close by or big on screen, draw the object itself */
+    if ((sph[2] - sph[3]) <= PL_Z_NEAR_PLANE ||
+        sph[3] >= (INT_MAX >> MAX_FOV) ||
+        ((sph[3] << PL_fov) / sph[2]) >= px) {
+        PL_render_object(obj);
+        return;
+    }
+    make_key(key, sph);
+    e = find(obj, id);
+    if (!fresh(e->key, key)) {
+        memcpy(e->key, key, sizeof(key));
+        update(e, obj, sph);
+    }
+    e->used = ++imp_clock;
+    draw(e, sph);
+}
+
+extern void
+PL_impostor_flush(void)
+{
+    int i;
+
+    for (i = 0; i < n_imps; i++) {
+        imps[i].obj = NULL;
+    }
+}
+
+extern void
+PL_impostor_budget(int bytes)
+{
+    int i, n;
+
+    for (i = 0; i < n_imps; i++) {
+        EXT_free(imps[i].tex.data);
+    }
+    if (imps) {
+        EXT_free(imps);
+        imps = NULL;
+    }
+    n_imps = 0;
+    n = bytes / (int) (PL_REQ_TEX_DIM * PL_REQ_TEX_DIM * sizeof(int));
+    if (n <= 0) {
+        return;
+    }
+    imps = EXT_calloc(n, sizeof(struct IMP));
+    if (imps == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "impostor", "no memory");
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        imps[i].tex.data = EXT_calloc(PL_REQ_TEX_DIM * PL_REQ_TEX_DIM,
+                                      sizeof(int));
+        if (imps[i].tex.data == NULL) {
+            EXT_error(PL_ERR_NO_MEM, "impostor", "no memory");
+            return;
+        }
+        n_imps++;
+    }
+}
@@ -26,8 +26,13 @@
  *      1 - flat rendering
  *      2 - textured rendering
  *      3 - toggle between two FOVs
+ *      4 - cycle through interlacing modes
+ *      5 - toggle dynamic resolution
  *      SPACE - start/stop dynamic transformation
  * 
+ * Frames that would look the same as the last one are skipped,
+ * the demo then sleeps until something changes.
+ * 
  */
 
 #include "fw/fw.h"
@@ -64,8 +69,12 @@ EXT_error(int err_id, char *modname, char *msg)
 #define GRSZ 1
 /* movement speed */
 #define MOVSPD 4
+/* frame time budget for dynamic resolution (ms) */
+#define DRBUDGET 8
 
 static struct PL_OBJ *floortile;
+/* one matrix per floor tile */
+static int tiles[(GRSZ * 2) * (GRSZ * 2) * 16];
 static struct PL_OBJ *texcube;
 static struct PL_OBJ *imported;
 static int camrx = 0, camry = 0;
@@ -107,6 +116,24 @@ maketex(void)
     checktex.data = checker;
 }
 
+static void
+maketiles(void)
+{
+    int idt[16] = PL_IDT_MAT;
+    int i, j, *m;
+
+    m = tiles;
+    for (i = -GRSZ; i < GRSZ; i++) {
+        for (j = -GRSZ; j < GRSZ; j++) {
+            PL_mat_cpy(m, idt);
+            m[12] = 0 + i * CUSZ;
+            m[13] = 0;
+            m[14] = 600 + j * CUSZ;
+            m += 16;
+        }
+    }
+}
+
 static void
 init(void)
 {
@@ -116,8 +143,13 @@ init(void)
 	texcube = PL_gen_box(CUSZ, CUSZ, CUSZ, PL_ALL, 255, 255, 255);
 	PL_texture(NULL);
 	floortile = PL_gen_box(CUSZ, CUSZ, CUSZ, PL_TOP, 77, 101, 94);
+	maketiles();
 
 	import_dmdl("pots", &imported);
+	/* the largest model, give it the faster vertex layout */
+	PL_soa_object(imported);
+	/* and draw it as a picture of itself once it is far away */
+	PL_impostor_budget(4 * PL_REQ_TEX_DIM * PL_REQ_TEX_DIM * sizeof(int));
 	
 	PL_fov = 9;
     
@@ -198,6 +230,24 @@ update(void)
 		printf("fov: %d\n", PL_fov);
 	}
 
+	if (pkb_key_pressed('4')) {
+		if (PL_interlace == PL_ILACE_OFF) {
+		    PL_interlace = PL_ILACE_ON;
+		} else if (PL_interlace == PL_ILACE_ON) {
+		    PL_interlace = PL_ILACE_BLEND;
+		} else {
+		    PL_interlace = PL_ILACE_OFF;
+		}
+		printf("interlace: %d\n", PL_interlace);
+	}
+
+	if (pkb_key_pressed('5')) {
+		static int dynres = 0;
+		dynres = !dynres;
+		PL_dynres(dynres ? DRBUDGET : 0, PL_DR_STEPS / 2);
+		printf("dynamic resolution: %d\n", dynres);
+	}
+
 	if (pkb_key_pressed(' ')) {
 		rot = !rot;
 	}
@@ -205,19 +255,23 @@ update(void)
 }
 
 static void
-display(void)
+draw(void)
 {
-    int i = 0, j = 0;
     int p1 = PL_P_ONE;
     int mo;
 
-    /* clear viewport to black */
-	PL_clear_vp(0, 0, 0);
-	PL_polygon_count = 0;
-    
     /* define camera orientation */
     PL_set_camera(x, y, z, camrx, camry);
     
+    /* the tile grid never moves, it is kept in a layer
+     * that is only redrawn when the camera moves */
+    if (!PL_layer_restore()) {
+        /* clear viewport to black */
+        PL_clear_vp(0, 0, 0);
+        PL_render_instances(floortile, tiles, (GRSZ * 2) * (GRSZ * 2));
+        PL_layer_save();
+    }
+    
     { /* draw imported model */
         PL_mst_push();
         if (rot) {
@@ -226,23 +280,10 @@ display(void)
         } else {
             PL_mst_translate(0, 400, 500);
         }
-        PL_render_object(imported);
+        PL_render_impostor(imported, 0, 32);
         PL_mst_pop();
     }
     
-    /* draw tile grid */
-    for (i = -GRSZ; i < GRSZ; i++) {
-        for (j = -GRSZ; j < GRSZ; j++) {
-            PL_mst_push();
-            PL_mst_translate(
-                       0 + i * CUSZ,
-                       0,
-                     600 + j * CUSZ);
-            PL_render_object(floortile);
-            PL_mst_pop();
-        }
-    }
-
     { /* draw textured cube */
         PL_mst_push();
         PL_mst_translate(-100, 100, 500);
@@ -254,15 +295,37 @@ display(void)
         PL_render_object(texcube);
         PL_mst_pop();
     }
-	
+}
+
+static void
+display(void)
+{
+    utime beg;
+
 	if (clk_sample() > fpsclock) {
 	    fpsclock = clk_sample() + 1000;
 	    printf("FPS: %d\n", sys_getfps());
 	}
 
+    beg = clk_sample();
+    /* go through the frame without drawing, if it matches
+     * the last one there is nothing to do until the next update */
+    PL_probe_begin();
+    draw();
+    if (!PL_probe_end()) {
+        sys_idle();
+        return;
+    }
+	PL_polygon_count = 0;
+    draw();
+
 	/* update window and sync */
-    vid_blit();
+    PL_present();
+    vid_blitsub(PL_hres, PL_vres);
     vid_sync();
+    if (PL_dynres_frame(clk_sample() - beg)) {
+        printf("resolution: %dx%d\n", PL_hres, PL_vres);
+    }
 }
 
 int
@@ -42,25 +42,119 @@ int PL_sin[PL_TRIGMAX] = {
 
 int PL_cos[PL_TRIGMAX];
 
-static struct {
-	int tx, ty, tz;
-	unsigned int rx, ry;
-} xf_vw; /* view transform */
-
 static int mat_idt[16] = PL_IDT_MAT;
 static int mat_model[16] = PL_IDT_MAT;
+static int mat_view[16] = PL_IDT_MAT; /* camera, world to view space */
+static int mat_mv[16] = PL_IDT_MAT; /* model * view */
+static int mv_dirty = 1; /* mat_mv needs to be recomposed */
 static int mst_stack[PL_MAX_MST_DEPTH * 16];
 static int mst_top = 0;
 
+#define _M_(x, y) (((x) * (y)) >> PL_P)
+/* rounded, for matrices that are built once and used many times */
+#define P_HALF  (1 << (PL_P - 1))
+#define _MR_(x, y) (((x) * (y) + P_HALF) >> PL_P)
+
+/* what PL_mst_xf_sphere and PL_mst_eye worked out for the last 3x3
+ * part of the modelview they saw. objects drawn one after another with
+ * the same rotation and scale, like instances, only differ in their
+ * translation and reuse it */
+static int sph_rot[9];
+static int sph_maxl = -1;
+static int eye_rot[9];
+static int eye_cof[9];
+static int eye_det;
+static int eye_valid = 0;
+
 extern void
 PL_set_camera(int x, int y, int z, int rx, int ry)
 {
-	xf_vw.tx = -x;
-	xf_vw.ty = -y;
-	xf_vw.tz = -z;
-	
-    xf_vw.rx = (unsigned int) (PL_TRIGMAX - rx & PL_TRIGMSK);
-    xf_vw.ry = (unsigned int) (PL_TRIGMAX - ry & PL_TRIGMSK);
+    int sx, sy, cx, cy;
+    int *v = mat_view;
+
+    rx = (PL_TRIGMAX - rx) & PL_TRIGMSK;
+    ry = (PL_TRIGMAX - ry) & PL_TRIGMSK;
+    cx = PL_cos[rx];
+    sx = PL_sin[rx];
+    cy = PL_cos[ry];
+    sy = PL_sin[ry];
+
+    /* yaw then pitch */
+    v[0]  = cy;
+    v[1]  = _MR_(sy, sx);
+    v[2]  = -_MR_(sy, cx);
+    v[3]  = 0;
+    v[4]  = 0;
+    v[5]  = cx;
+    v[6]  = sx;
+    v[7]  = 0;
+    v[8]  = sy;
+    v[9]  = -_MR_(cy, sx);
+    v[10] = _MR_(cy, cx);
+    v[11] = 0;
+    /* translation is applied before rotating */
+    v[12] = -((x * v[0] + y * v[4] + z * v[8]  + P_HALF) >> PL_P);
+    v[13] = -((x * v[1] + y * v[5] + z * v[9]  + P_HALF) >> PL_P);
+    v[14] = -((x * v[2] + y * v[6] + z * v[10] + P_HALF) >> PL_P);
+    v[15] = PL_P_ONE;
+    mv_dirty = 1;
+}
+
+extern void
+PL_set_camera_mat(int *m)
+{
+    PL_mat_cpy(mat_view, m);
+    mv_dirty = 1;
+}
+
+extern void
+PL_get_camera_mat(int *m)
+{
+    PL_mat_cpy(m, mat_view);
+}
+
+/* copy the 3x3 part of m into rot, returns 1 if it was the same */
+static int
+same_rot(int *rot, int *m)
+{
+    int i, j, same = 1;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            if (rot[i * 3 + j] != m[i * 4 + j]) {
+                rot[i * 3 + j] = m[i * 4 + j];
+                same = 0;
+            }
+        }
+    }
+    return same;
+}
+
+/* compose the model and view matrices if either changed */
+static int *
+modelview(void)
+{
+    int *m = mat_model;
+    int *v = mat_view;
+    int i, j;
+
+    if (mv_dirty) {
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < 3; j++) {
+                mat_mv[i * 4 + j] = _MR_(m[i * 4 + 0], v[0 + j]) +
+                                    _MR_(m[i * 4 + 1], v[4 + j]) +
+                                    _MR_(m[i * 4 + 2], v[8 + j]);
+            }
+        }
+        /* translation gets only one rounding, it isn't scaled down later */
+        for (j = 0; j < 3; j++) {
+            mat_mv[12 + j] = ((m[12] * v[0 + j] + m[13] * v[4 + j] +
+                               m[14] * v[8 + j] + P_HALF) >> PL_P) +
+                             v[12 + j];
+        }
+        mv_dirty = 0;
+    }
+    return mat_mv;
 }
 
 extern void
@@ -69,6 +163,12 @@ PL_mst_get(int *out)
 	PL_mat_cpy(out, mat_model);
 }
 
+extern void
+PL_mst_get_mv(int *out)
+{
+	PL_mat_cpy(out, modelview());
+}
+
 extern void
 PL_mst_push(void)
 {
@@ -86,160 +186,240 @@ PL_mst_pop(void)
 	    EXT_error(PL_ERR_MISC, "math", "stack underflow");
 	}
 	PL_mat_cpy(mat_model, &mst_stack[(mst_top--) * 16]);
+	mv_dirty = 1;
 }
 
 extern void
 PL_mst_load_idt(void)
 {	
 	PL_mat_cpy(mat_model, mat_idt);
+	mv_dirty = 1;
 }
 
 extern void
 PL_mst_load(int *m)
 {
 	PL_mat_cpy(mat_model, m);
+	mv_dirty = 1;
 }
 
 extern void
 PL_mst_mul(int *m)
 {
 	PL_mat_mul(mat_model, m);
+	mv_dirty = 1;
 }
 
+/* the functions below update the model matrix in place, doing only the
+ * work that multiplying by the equivalent 4x4 matrix would not waste */
+
 extern void
 PL_mst_scale(int x, int y, int z)
 {
-	int mat[16];
-	
-	memcpy(mat, mat_idt, sizeof(mat));
-	
-	mat[0]  = x;
-	mat[5]  = y;
-	mat[10] = z;
-	PL_mst_mul(mat);
+    int *m = mat_model;
+    int j;
+
+    for (j = 0; j < 3; j++) {
+        m[0 + j] = _M_(x, m[0 + j]);
+        m[4 + j] = _M_(y, m[4 + j]);
+        m[8 + j] = _M_(z, m[8 + j]);
+    }
+    mv_dirty = 1;
 }
 
 extern void
 PL_mst_translate(int x, int y, int z)
 {
-    int mat[16];
-    
-    memcpy(mat, mat_idt, sizeof(mat));
-    
-	mat[12] = x;
-	mat[13] = y;
-	mat[14] = z;
-	PL_mst_mul(mat);
-}
+    int *m = mat_model;
+    int j;
 
-#define _M_(x, y) (((x) * (y)) >> PL_P)
-#define _MI_(i, j) (((i) << 2) + (j))
+    for (j = 0; j < 3; j++) {
+        m[12 + j] += _M_(x, m[0 + j]) + _M_(y, m[4 + j]) + _M_(z, m[8 + j]);
+    }
+    mv_dirty = 1;
+}
 
 extern void
 PL_mst_rotatex(int rx)
 {
     int cx, sx;
-    int mat[16];
-      
-    memcpy(mat, mat_idt, sizeof(mat));
-    
+    int *m = mat_model;
+    int j, r1;
+
     cx = PL_cos[rx & PL_TRIGMSK];
     sx = PL_sin[rx & PL_TRIGMSK];
 
-    mat[_MI_(1, 1)] = cx;
-    mat[_MI_(2, 1)] = -sx;
-    mat[_MI_(1, 2)] = sx;
-    mat[_MI_(2, 2)] = cx;
-    
-    PL_mst_mul(mat);
+    for (j = 0; j < 3; j++) {
+        r1 = m[4 + j];
+        m[4 + j] = _M_(cx, r1) + _M_(sx, m[8 + j]);
+        m[8 + j] = _M_(-sx, r1) + _M_(cx, m[8 + j]);
+    }
+    mv_dirty = 1;
 }
 
 extern void
 PL_mst_rotatey(int ry)
 {
     int cy, sy;
-    int mat[16];
-      
-    memcpy(mat, mat_idt, sizeof(mat));
+    int *m = mat_model;
+    int j, r0;
 
     cy = PL_cos[ry & PL_TRIGMSK];
     sy = PL_sin[ry & PL_TRIGMSK];
-    
-    mat[_MI_(0, 0)] = cy;
-    mat[_MI_(2, 0)] = sy;
-    mat[_MI_(0, 2)] = -sy;
-    mat[_MI_(2, 2)] = cy;
-    
-    PL_mst_mul(mat);
+
+    for (j = 0; j < 3; j++) {
+        r0 = m[0 + j];
+        m[0 + j] = _M_(cy, r0) + _M_(-sy, m[8 + j]);
+        m[8 + j] = _M_(sy, r0) + _M_(cy, m[8 + j]);
+    }
+    mv_dirty = 1;
 }
 
 extern void
 PL_mst_rotatez(int rz)
 {
     int cz, sz;
-    int mat[16];
-    
-    memcpy(mat, mat_idt, sizeof(mat));
-      
+    int *m = mat_model;
+    int j, r0;
+
     cz = PL_cos[rz & PL_TRIGMSK];
     sz = PL_sin[rz & PL_TRIGMSK];
-    
-    mat[_MI_(0, 0)] = cz;
-    mat[_MI_(1, 0)] = sz;
-    mat[_MI_(0, 1)] = -sz;
-    mat[_MI_(1, 1)] = cz;
-    
-    PL_mst_mul(mat);
-}
 
-#undef _MI_
+    for (j = 0; j < 3; j++) {
+        r0 = m[0 + j];
+        m[0 + j] = _M_(cz, r0) + _M_(-sz, m[4 + j]);
+        m[4 + j] = _M_(sz, r0) + _M_(cz, m[4 + j]);
+    }
+    mv_dirty = 1;
+}
 
 extern void
 PL_mst_xf_modelview_vec(int *v, int *out, int len)
 {
-    register int sx, sy, cx, cy;
-    register int x, y, z, w;
-    int xx, yy, zz;
-    int tx, ty, tz;
+    register int x, y, z;
     int *m;
 
-    cx = PL_cos[xf_vw.rx];
-    sx = PL_sin[xf_vw.rx];
-    cy = PL_cos[xf_vw.ry];
-    sy = PL_sin[xf_vw.ry];
-
-    m = mat_model;
-    
-	tx = xf_vw.tx + m[12];
-	ty = xf_vw.ty + m[13];
-	tz = xf_vw.tz + m[14];
+    m = modelview();
 
     while ((len--) > 0) {
         x = v[0];
         y = v[1];
         z = v[2];
 
-        xx = ((x * m[0] + y * m[4] + z * m[8])  >> PL_P) + tx;
-        yy = ((x * m[1] + y * m[5] + z * m[9])  >> PL_P) + ty;
-        zz = ((x * m[2] + y * m[6] + z * m[10]) >> PL_P) + tz;
+        out[0] = ((x * m[0] + y * m[4] + z * m[8])  >> PL_P) + m[12];
+        out[1] = ((x * m[1] + y * m[5] + z * m[9])  >> PL_P) + m[13];
+        out[2] = ((x * m[2] + y * m[6] + z * m[10]) >> PL_P) + m[14];
+        v   += PL_VLEN;
+        out += PL_VLEN;
+    }
+}
 
-        /* yaw */
-        w  = (zz * sy + xx * cy) >> PL_P;
-        zz = (zz * cy - xx * sy) >> PL_P;
-        xx = w;
+extern void
+PL_mst_xf_sphere(int *s, int *out)
+{
+    int *m;
+    int i, l, maxl = 0;
+
+    PL_mst_xf_modelview_vec(s, out, 1);
+    /* the rows are the object's axes in view space,
+     * the longest one is the most the radius can grow */
+    m = modelview();
+    if (!same_rot(sph_rot, m) || sph_maxl < 0) {
+        for (i = 0; i < 3; i++) {
+            l = PL_vec_len(m + i * 4);
+            if (l > maxl) {
+                maxl = l;
+            }
+        }
+        sph_maxl = maxl;
+    }
+    maxl = sph_maxl;
+    /* split so large radii don't overflow,
+     * plus a little for the rounding of the transform */
+    out[3] = (((s[3] >> 8) * maxl) >> (PL_P - 8)) +
+             (((s[3] & 0xff) * maxl) >> PL_P) + 2;
+}
+
+extern int
+PL_mst_eye(int *eye)
+{
+    int *m, *t, *c;
+    int i, j, det, w, q;
+
+    m = modelview();
+    t = m + 12;
+    c = eye_cof;
+    if (!same_rot(eye_rot, m) || !eye_valid) {
+        /* cofactors of the 3x3 part, c[j * 3 + i] belongs to m[j * 4 + i] */
+        for (j = 0; j < 3; j++) {
+            for (i = 0; i < 3; i++) {
+                c[j * 3 + i] =
+                    _MR_(m[((j + 1) % 3) * 4 + (i + 1) % 3],
+                         m[((j + 2) % 3) * 4 + (i + 2) % 3]) -
+                    _MR_(m[((j + 1) % 3) * 4 + (i + 2) % 3],
+                         m[((j + 2) % 3) * 4 + (i + 1) % 3]);
+            }
+        }
+        eye_det = _MR_(m[0], c[0]) + _MR_(m[1], c[1]) + _MR_(m[2], c[2]);
+        eye_valid = 1;
+    }
+    det = eye_det;
+    if (det == 0) {
+        return 0;
+    }
 
-        /* pitch */
-        w  = (yy * cx - zz * sx) >> PL_P;
-        zz = (yy * sx + zz * cx) >> PL_P;
-        yy = w;
+    /* eye = -t * inverse = -t * transpose(c) / det, the dot product
+     * is done at 1/256 so a far away camera doesn't overflow */
+    for (j = 0; j < 3; j++) {
+        w = 0;
+        for (i = 0; i < 3; i++) {
+            w += (t[i] >> 8) * c[j * 3 + i] +
+                 (((t[i] & 0xff) * c[j * 3 + i]) >> 8);
+        }
+        q = w / det;
+        eye[j] = -(q * 256 + (w - q * det) * 256 / det);
+    }
+    return (det < 0) ? -1 : 1;
+}
 
-        out[0] = xx;
-        out[1] = yy;
-        out[2] = zz;
-        v   += PL_VLEN;
-        out += PL_VLEN;
+extern void
+PL_mst_xf_modelview_soa(int *soa, int *out, int len)
+{
+    int f[12];
+    int ox[PL_SOA_BLK], oy[PL_SOA_BLK], oz[PL_SOA_BLK];
+    int *bx, *by, *bz, *m;
+    int i, n;
+
+    /* local copy of the 3x4 part so the compiler knows it can't alias */
+    m = modelview();
+    for (i = 0; i < 3; i++) {
+        f[i * 3 + 0] = m[i * 4 + 0];
+        f[i * 3 + 1] = m[i * 4 + 1];
+        f[i * 3 + 2] = m[i * 4 + 2];
+        f[9 + i] = m[12 + i];
     }
 
+    while (len > 0) {
+        bx = soa;
+        by = soa + PL_SOA_BLK;
+        bz = soa + PL_SOA_BLK * 2;
+        /* blocks are padded, always do the whole block so the
+         * compiler can keep this loop free of branches */
+        for (i = 0; i < PL_SOA_BLK; i++) {
+            ox[i] = ((bx[i] * f[0] + by[i] * f[3] + bz[i] * f[6]) >> PL_P);
+            oy[i] = ((bx[i] * f[1] + by[i] * f[4] + bz[i] * f[7]) >> PL_P);
+            oz[i] = ((bx[i] * f[2] + by[i] * f[5] + bz[i] * f[8]) >> PL_P);
+        }
+        n = (len < PL_SOA_BLK) ? len : PL_SOA_BLK;
+        for (i = 0; i < n; i++) {
+            out[0] = ox[i] + f[9];
+            out[1] = oy[i] + f[10];
+            out[2] = oz[i] + f[11];
+            out += PL_VLEN;
+        }
+        soa += PL_SOA_BLK * 3;
+        len -= PL_SOA_BLK;
+    }
 }
 
 extern void
@@ -249,6 +429,26 @@ PL_mat_mul(int *a, int *b)
 	
 	memcpy(m, a, sizeof(m));
 	
+	if (b[3] == 0 && b[7] == 0 && b[11] == 0 && b[15] == PL_P_ONE) {
+	    /* affine, the last column contributes nothing */
+	    a[0]  = _M_(b[0], m[0])  + _M_(b[1], m[4])  + _M_(b[2], m[8]);
+	    a[1]  = _M_(b[0], m[1])  + _M_(b[1], m[5])  + _M_(b[2], m[9]);
+	    a[2]  = _M_(b[0], m[2])  + _M_(b[1], m[6])  + _M_(b[2], m[10]);
+	    a[4]  = _M_(b[4], m[0])  + _M_(b[5], m[4])  + _M_(b[6], m[8]);
+	    a[5]  = _M_(b[4], m[1])  + _M_(b[5], m[5])  + _M_(b[6], m[9]);
+	    a[6]  = _M_(b[4], m[2])  + _M_(b[5], m[6])  + _M_(b[6], m[10]);
+	    a[8]  = _M_(b[8], m[0])  + _M_(b[9], m[4])  + _M_(b[10], m[8]);
+	    a[9]  = _M_(b[8], m[1])  + _M_(b[9], m[5])  + _M_(b[10], m[9]);
+	    a[10] = _M_(b[8], m[2])  + _M_(b[9], m[6])  + _M_(b[10], m[10]);
+	    a[12] = _M_(b[12], m[0]) + _M_(b[13], m[4]) + _M_(b[14], m[8]) +
+	            m[12];
+	    a[13] = _M_(b[12], m[1]) + _M_(b[13], m[5]) + _M_(b[14], m[9]) +
+	            m[13];
+	    a[14] = _M_(b[12], m[2]) + _M_(b[13], m[6]) + _M_(b[14], m[10]) +
+	            m[14];
+	    return;
+	}
+	
 	a[0] =  _M_(b[0], m[0])  + _M_(b[1], m[4]) +
 	        _M_(b[2], m[8])  + _M_(b[3], m[12]);
 	a[1] =  _M_(b[0], m[1])  + _M_(b[1], m[5]) +
@@ -279,6 +479,7 @@ PL_mat_mul(int *a, int *b)
 }
 
 #undef _M_
+#undef _MR_
 
 extern void
 PL_mat_cpy(int *dst, int *src)
@@ -286,6 +487,73 @@ PL_mat_cpy(int *dst, int *src)
 	memcpy(dst, src, sizeof(int) * 16);
 }
 
+/* bumped whenever any transform node changes. a node checked since
+ * the last bump is known to be up to date without looking at its
+ * parents, so a hierarchy that isn't moving costs nothing */
+static unsigned xf_rev = 1;
+static unsigned xf_stamp = 0;
+
+extern void
+PL_xf_init(struct PL_XFNODE *n, struct PL_XFNODE *parent)
+{
+    PL_mat_cpy(n->local, mat_idt);
+    PL_mat_cpy(n->world, mat_idt);
+    n->parent = parent;
+    n->stamp = 0;
+    n->parent_stamp = 0;
+    n->checked = 0;
+    PL_xf_dirty(n);
+}
+
+extern void
+PL_xf_set(struct PL_XFNODE *n, int *local)
+{
+    PL_mat_cpy(n->local, local);
+    PL_xf_dirty(n);
+}
+
+extern void
+PL_xf_dirty(struct PL_XFNODE *n)
+{
+    n->dirty = 1;
+    xf_rev++;
+}
+
+extern int *
+PL_xf_world(struct PL_XFNODE *n)
+{
+    struct PL_XFNODE *p = n->parent;
+
+    if (n->checked == xf_rev) {
+        return n->world;
+    }
+    if (p) {
+        PL_xf_world(p);
+        if (p->stamp != n->parent_stamp) {
+            n->dirty = 1;
+        }
+    }
+    if (n->dirty) {
+        if (p) {
+            PL_mat_cpy(n->world, p->world);
+            PL_mat_mul(n->world, n->local);
+            n->parent_stamp = p->stamp;
+        } else {
+            PL_mat_cpy(n->world, n->local);
+        }
+        n->stamp = ++xf_stamp;
+        n->dirty = 0;
+    }
+    n->checked = xf_rev;
+    return n->world;
+}
+
+extern void
+PL_xf_load(struct PL_XFNODE *n)
+{
+    PL_mst_load(PL_xf_world(n));
+}
+
 extern int
 PL_winding_order(int *a, int *b, int *c)
 {
@@ -310,6 +578,56 @@ PL_vec_shorten(int *v)
     }
 }
 
+extern int
+PL_isqrt(int x)
+{
+    unsigned int r, b, n;
+
+    if (x <= 0) {
+        return 0;
+    }
+    n = x;
+    r = 0;
+    b = 1u << 30;
+    while (b > n) {
+        b >>= 2;
+    }
+    while (b) {
+        if (n >= r + b) {
+            n -= r + b;
+            r = (r >> 1) + b;
+        } else {
+            r >>= 1;
+        }
+        b >>= 2;
+    }
+    return (int) r;
+}
+
+extern int
+PL_vec_len(int *v)
+{
+    int x, y, z;
+    int l, sq, s = 0;
+
+    x = v[0] < 0 ? -v[0] : v[0];
+    y = v[1] < 0 ? -v[1] : v[1];
+    z = v[2] < 0 ? -v[2] : v[2];
+    /* keep the sum of squares in range, rounding up */
+    while (x > 16383 || y > 16383 || z > 16383) {
+        x = (x + 1) >> 1;
+        y = (y + 1) >> 1;
+        z = (z + 1) >> 1;
+        s++;
+    }
+    sq = x * x + y * y + z * z;
+    l = PL_isqrt(sq);
+    if ((l * l) < sq) {
+        l++;
+    }
+    return l << s;
+}
+
 extern void
 PL_psp_project(int *src, int *dst, int len, int num, int fov)
 {
@@ -0,0 +1,688 @@
+/*****************************************************************************/
+/*
+ * PiSHi LE (Lite edition) - Fundamentals of the King's Crook graphics engine.
+ *
+ *   by EMMIR 2018-2022
+ *
+ *   YouTube: https://www.youtube.com/c/LMP88
+ *
+ * This software is released into the public domain.
+ */
+/*****************************************************************************/
+
+#include "pl.h"
+
+/*  mdlsimp.c
+ *
+ * Offline mesh simplifier. Reads a DMDL model, collapses edges until
+ * it is down to each requested polygon count and writes every level
+ * out as a DMDL file, ready to be imported and given to PL_add_lod.
+ *
+ * usage: mdlsimp model [polygons ...]
+ *
+ * model is the name without .dmdl, levels go to model_lod1.dmdl,
+ * model_lod2.dmdl and so on. default counts are 1/2, 1/4 and 1/8.
+ *
+ * An edge collapse moves one vertex onto a neighbor, the cheapest
+ * one is the one that moves the surface the least. Vertices on the
+ * mesh boundary or on a texture coordinate or color seam are kept.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+extern void *
+EXT_calloc(unsigned n, unsigned esz)
+{
+    return calloc(n, esz);
+}
+
+extern void
+EXT_free(void *p)
+{
+    free(p);
+}
+
+extern void
+EXT_error(int err_id, char *modname, char *msg)
+{
+    printf("vx error 0x%x in %s: %s\n", err_id, modname, msg);
+    exit(1);
+}
+
+#define MAX_LEVELS 16
+/* never collapse an edge that costs more than this */
+#define MAX_COST (1 << 20)
+
+/* polygons around a vertex, dead ones are skipped */
+struct ADJ {
+    int *p;
+    int n, cap;
+};
+
+/* a possible collapse of vertex u onto vertex v */
+struct CAND {
+    int cost;
+    int u, v;
+    int stamp;
+};
+
+static struct PL_OBJ *mdl;
+static struct ADJ *adj;
+static int *dead;   /* polygon is gone */
+static int *gone;   /* vertex was collapsed into another */
+static int *locked; /* vertex may not be collapsed */
+static int *err;    /* how far the surface around a vertex has moved */
+static int *stamp;  /* candidates with an older stamp are stale */
+static int n_alive;
+
+static struct CAND *heap;
+static int heap_n, heap_cap;
+
+static void *
+alloc(int n, int esz)
+{
+    void *p;
+
+    p = calloc(n ? n : 1, esz);
+    if (p == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "mdlsimp", "no memory");
+    }
+    return p;
+}
+
+static void
+adj_add(int v, int p)
+{
+    struct ADJ *a = &adj[v];
+    int *np;
+    int i;
+
+    for (i = 0; i < a->n; i++) {
+        if (a->p[i] == p) {
+            return;
+        }
+    }
+    if (a->n == a->cap) {
+        a->cap = a->cap ? a->cap * 2 : 8;
+        np = alloc(a->cap, sizeof(int));
+        if (a->p) {
+            memcpy(np, a->p, a->n * sizeof(int));
+            free(a->p);
+        }
+        a->p = np;
+    }
+    a->p[a->n++] = p;
+}
+
+static int
+less(struct CAND *a, struct CAND *b)
+{
+    if (a->cost != b->cost) {
+        return a->cost < b->cost;
+    }
+    return a->u < b->u;
+}
+
+static void
+heap_push(int cost, int u, int v)
+{
+    struct CAND *nh, t;
+    int i, up;
+
+    if (heap_n == heap_cap) {
+        heap_cap = heap_cap ? heap_cap * 2 : 1024;
+        nh = alloc(heap_cap, sizeof(struct CAND));
+        if (heap) {
+            memcpy(nh, heap, heap_n * sizeof(struct CAND));
+            free(heap);
+        }
+        heap = nh;
+    }
+    i = heap_n++;
+    heap[i].cost = cost;
+    heap[i].u = u;
+    heap[i].v = v;
+    heap[i].stamp = stamp[u];
+    while (i > 0) {
+        up = (i - 1) / 2;
+        if (!less(&heap[i], &heap[up])) {
+            break;
+        }
+        t = heap[i];
+        heap[i] = heap[up];
+        heap[up] = t;
+        i = up;
+    }
+}
+
+static void
+heap_pop(struct CAND *out)
+{
+    struct CAND t;
+    int i, c;
+
+    *out = heap[0];
+    heap[0] = heap[--heap_n];
+    i = 0;
+    for (;;) {
+        c = i * 2 + 1;
+        if (c >= heap_n) {
+            break;
+        }
+        if (c + 1 < heap_n && less(&heap[c + 1], &heap[c])) {
+            c++;
+        }
+        if (!less(&heap[c], &heap[i])) {
+            break;
+        }
+        t = heap[i];
+        heap[i] = heap[c];
+        heap[c] = t;
+        i = c;
+    }
+}
+
+static int *
+corner(int p, int i)
+{
+    return mdl->polys[p].verts + i * PL_POLY_VLEN;
+}
+
+static int
+nverts(int p)
+{
+    return mdl->polys[p].n_verts & 0xf;
+}
+
+/* corner of vertex v in polygon p, -1 if it isn't in it */
+static int
+find(int p, int v)
+{
+    int i;
+
+    for (i = 0; i < nverts(p); i++) {
+        if (corner(p, i)[0] == v) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int *
+pos(int v)
+{
+    return mdl->verts + v * PL_VLEN;
+}
+
+/* vertex indices of polygon p after collapsing u onto v */
+static int
+collapsed(int p, int u, int v, int *idx)
+{
+    int i, n, c, hasv;
+
+    hasv = find(p, v) >= 0;
+    n = 0;
+    for (i = 0; i < nverts(p); i++) {
+        c = corner(p, i)[0];
+        if (c == u) {
+            if (hasv) {
+                continue;
+            }
+            c = v;
+        }
+        idx[n++] = c;
+    }
+    return n;
+}
+
+/* area normal of a polygon, the sum of its fan triangles.
+ * coordinates are shifted down together so the sum can't overflow */
+static void
+area_normal(int *idx, int n, int *out)
+{
+    int d[6][3];
+    int i, j, m, s;
+
+    m = 0;
+    for (i = 1; i < n; i++) {
+        for (j = 0; j < 3; j++) {
+            d[i][j] = pos(idx[i])[j] - pos(idx[0])[j];
+            m |= abs(d[i][j]);
+        }
+    }
+    s = 0;
+    while ((m >> s) > 4095) {
+        s++;
+    }
+    for (i = 1; i < n; i++) {
+        for (j = 0; j < 3; j++) {
+            d[i][j] >>= s;
+        }
+    }
+    out[0] = out[1] = out[2] = 0;
+    for (i = 1; i < n - 1; i++) {
+        out[0] += d[i][1] * d[i + 1][2] - d[i][2] * d[i + 1][1];
+        out[1] += d[i][2] * d[i + 1][0] - d[i][0] * d[i + 1][2];
+        out[2] += d[i][0] * d[i + 1][1] - d[i][1] * d[i + 1][0];
+    }
+}
+
+/* shift a vector down until every component fits in lim */
+static void
+shorten(int *v, int lim)
+{
+    while (abs(v[0]) > lim || abs(v[1]) > lim || abs(v[2]) > lim) {
+        v[0] /= 2;
+        v[1] /= 2;
+        v[2] /= 2;
+    }
+}
+
+static int
+dot(int *a, int *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/* every corner of a polygon turns the same way as its normal */
+static int
+convex(int *idx, int n, int *nrm)
+{
+    int a[3], b[3], c[3];
+    int i, j, *p0, *p1, *p2;
+
+    if (n < 4) {
+        return 1;
+    }
+    for (i = 0; i < n; i++) {
+        p0 = pos(idx[i]);
+        p1 = pos(idx[(i + 1) % n]);
+        p2 = pos(idx[(i + 2) % n]);
+        for (j = 0; j < 3; j++) {
+            a[j] = p1[j] - p0[j];
+            b[j] = p2[j] - p1[j];
+        }
+        shorten(a, 2047);
+        shorten(b, 2047);
+        c[0] = a[1] * b[2] - a[2] * b[1];
+        c[1] = a[2] * b[0] - a[0] * b[2];
+        c[2] = a[0] * b[1] - a[1] * b[0];
+        shorten(c, 8191);
+        if (dot(c, nrm) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* how far collapsing u onto v moves the surface, rounded up.
+ * -1 if it would flip, flatten or fold a polygon */
+static int
+cost(int u, int v)
+{
+    int idx[6], on[3], nn[3], d[3];
+    int i, j, n, p, s, len, dist, worst;
+
+    worst = 0;
+    for (i = 0; i < adj[u].n; i++) {
+        p = adj[u].p[i];
+        if (dead[p]) {
+            continue;
+        }
+        n = collapsed(p, u, v, idx);
+        if (n < 3) {
+            continue;
+        }
+        area_normal(idx, n, nn);
+        if (nn[0] == 0 && nn[1] == 0 && nn[2] == 0) {
+            return -1;
+        }
+        shorten(nn, 8191);
+        n = nverts(p);
+        for (j = 0; j < n; j++) {
+            idx[j] = corner(p, j)[0];
+        }
+        area_normal(idx, n, on);
+        shorten(on, 8191);
+        if (dot(on, nn) <= 0) {
+            return -1;
+        }
+        n = collapsed(p, u, v, idx);
+        if (!convex(idx, n, nn)) {
+            return -1;
+        }
+        /* distance of u from the plane the polygon ends up in */
+        for (j = 0; j < 3; j++) {
+            d[j] = pos(u)[j] - pos(v)[j];
+        }
+        len = PL_vec_len(nn);
+        s = 0;
+        while (abs(d[0]) > 16383 || abs(d[1]) > 16383 || abs(d[2]) > 16383) {
+            d[0] /= 2;
+            d[1] /= 2;
+            d[2] /= 2;
+            s++;
+        }
+        dist = (abs(dot(nn, d)) + len - 1) / len;
+        if (dist > (MAX_COST >> s)) {
+            return -1;
+        }
+        dist <<= s;
+        if (dist > worst) {
+            worst = dist;
+        }
+    }
+    return worst;
+}
+
+/* vertices with a polygon edge that no other polygon shares,
+ * or with different colors or texture coordinates around them */
+static void
+find_locks(void)
+{
+    int v, i, j, p, q, f, c, w, shared;
+    int *uv;
+
+    for (v = 0; v < mdl->n_verts; v++) {
+        if (adj[v].n == 0) {
+            continue;
+        }
+        f = adj[v].p[0];
+        uv = corner(f, find(f, v));
+        for (i = 0; i < adj[v].n; i++) {
+            p = adj[v].p[i];
+            c = find(p, v);
+            if (corner(p, c)[1] != uv[1] || corner(p, c)[2] != uv[2] ||
+                mdl->polys[p].color != mdl->polys[f].color ||
+                mdl->polys[p].tex != mdl->polys[f].tex) {
+                locked[v] = 1;
+                break;
+            }
+            w = corner(p, (c + 1) % nverts(p))[0];
+            shared = 0;
+            for (j = 0; j < adj[v].n; j++) {
+                q = adj[v].p[j];
+                if (q != p && find(q, w) >= 0) {
+                    shared = 1;
+                }
+            }
+            if (!shared) {
+                locked[v] = 1;
+                break;
+            }
+        }
+    }
+}
+
+/* find the cheapest collapse of u and queue it */
+static void
+consider(int u)
+{
+    int i, j, k, p, n, c, v, bv, bc, cst, len, d[3];
+
+    stamp[u]++;
+    if (locked[u] || gone[u]) {
+        return;
+    }
+    bv = -1;
+    bc = INT_MAX;
+    for (i = 0; i < adj[u].n; i++) {
+        p = adj[u].p[i];
+        if (dead[p]) {
+            continue;
+        }
+        n = nverts(p);
+        j = find(p, u);
+        for (c = 0; c < 2; c++) {
+            v = corner(p, (j + (c ? 1 : n - 1)) % n)[0];
+            cst = cost(u, v);
+            if (cst < 0 || cst > MAX_COST) {
+                continue;
+            }
+            /* break ties with the shorter edge */
+            for (k = 0; k < 3; k++) {
+                d[k] = pos(u)[k] - pos(v)[k];
+            }
+            shorten(d, 16383);
+            len = PL_vec_len(d);
+            cst = (cst << 10) + (len > 1023 ? 1023 : len);
+            if (cst < bc) {
+                bc = cst;
+                bv = v;
+            }
+        }
+    }
+    if (bv >= 0) {
+        heap_push(bc, u, bv);
+    }
+}
+
+static void
+collapse(int u, int v, int c)
+{
+    int i, j, k, n, p, cu, uv[2];
+    int *src;
+
+    /* texture coordinates v has next to u */
+    uv[0] = uv[1] = 0;
+    for (i = 0; i < adj[u].n; i++) {
+        p = adj[u].p[i];
+        if (!dead[p] && (k = find(p, v)) >= 0) {
+            uv[0] = corner(p, k)[1];
+            uv[1] = corner(p, k)[2];
+            break;
+        }
+    }
+    for (i = 0; i < adj[u].n; i++) {
+        p = adj[u].p[i];
+        if (dead[p]) {
+            continue;
+        }
+        n = nverts(p);
+        cu = find(p, u);
+        if (find(p, v) >= 0) {
+            if (n - 1 < 3) {
+                dead[p] = 1;
+                n_alive--;
+                continue;
+            }
+            for (j = cu; j < n - 1; j++) {
+                src = corner(p, j + 1);
+                corner(p, j)[0] = src[0];
+                corner(p, j)[1] = src[1];
+                corner(p, j)[2] = src[2];
+            }
+            n--;
+            mdl->polys[p].n_verts = n;
+        } else {
+            corner(p, cu)[0] = v;
+            corner(p, cu)[1] = uv[0];
+            corner(p, cu)[2] = uv[1];
+        }
+        /* the closing corner repeats the first */
+        src = corner(p, 0);
+        corner(p, n)[0] = src[0];
+        corner(p, n)[1] = src[1];
+        corner(p, n)[2] = src[2];
+        adj_add(v, p);
+    }
+    gone[u] = 1;
+    adj[u].n = 0;
+    if (err[u] + c > err[v]) {
+        err[v] = err[u] + c;
+    }
+}
+
+/* requeue every vertex that shares a polygon with v */
+static void
+refresh(int v)
+{
+    int i, j, p;
+
+    consider(v);
+    for (i = 0; i < adj[v].n; i++) {
+        p = adj[v].p[i];
+        if (dead[p]) {
+            continue;
+        }
+        for (j = 0; j < nverts(p); j++) {
+            if (corner(p, j)[0] != v) {
+                consider(corner(p, j)[0]);
+            }
+        }
+    }
+}
+
+static void
+simplify(int target)
+{
+    struct CAND c;
+    int cc;
+
+    while (n_alive > target && heap_n > 0) {
+        heap_pop(&c);
+        if (c.stamp != stamp[c.u] || gone[c.u] || gone[c.v]) {
+            continue;
+        }
+        cc = cost(c.u, c.v);
+        if (cc < 0) {
+            consider(c.u);
+            continue;
+        }
+        collapse(c.u, c.v, cc);
+        refresh(c.v);
+    }
+}
+
+/* copy what is left into a new object and write it out */
+static int
+save(char *name, int *out_verts, int *out_err)
+{
+    struct PL_OBJ o;
+    int *map;
+    int i, j, n, k, ok;
+    int *dv, *sv;
+
+    memset(&o, 0, sizeof(o));
+    map = alloc(mdl->n_verts, sizeof(int));
+    for (i = 0; i < mdl->n_verts; i++) {
+        map[i] = -1;
+    }
+    *out_err = 0;
+    for (i = 0; i < mdl->n_polys; i++) {
+        if (dead[i]) {
+            continue;
+        }
+        for (j = 0; j < nverts(i); j++) {
+            k = corner(i, j)[0];
+            if (map[k] < 0) {
+                map[k] = o.n_verts++;
+                if (err[k] > *out_err) {
+                    *out_err = err[k];
+                }
+            }
+        }
+        o.n_polys++;
+    }
+    o.verts = alloc(o.n_verts * PL_VLEN, sizeof(int));
+    o.polys = alloc(o.n_polys, sizeof(struct PL_POLY));
+    for (i = 0; i < mdl->n_verts; i++) {
+        if (map[i] >= 0) {
+            dv = o.verts + map[i] * PL_VLEN;
+            sv = pos(i);
+            dv[0] = sv[0];
+            dv[1] = sv[1];
+            dv[2] = sv[2];
+        }
+    }
+    n = 0;
+    for (i = 0; i < mdl->n_polys; i++) {
+        if (dead[i]) {
+            continue;
+        }
+        o.polys[n] = mdl->polys[i];
+        for (j = 0; j <= nverts(i); j++) {
+            o.polys[n].verts[j * PL_POLY_VLEN] = map[corner(i, j)[0]];
+        }
+        n++;
+    }
+    *out_verts = o.n_verts;
+    ok = export_dmdl(name, &o);
+    free(o.verts);
+    free(o.polys);
+    free(map);
+    return ok;
+}
+
+static int
+by_count(const void *a, const void *b)
+{
+    return *(const int *) b - *(const int *) a;
+}
+
+int
+main(int argc, char **argv)
+{
+    char name[1024];
+    int targets[MAX_LEVELS];
+    int i, j, n, nv, e;
+
+    if (argc < 2) {
+        printf("usage: %s model [polygons ...]\n", argv[0]);
+        return 1;
+    }
+    if (!import_dmdl(argv[1], &mdl)) {
+        return 1;
+    }
+    n = 0;
+    for (i = 2; i < argc && n < MAX_LEVELS; i++) {
+        targets[n] = atoi(argv[i]);
+        if (targets[n] > 0 && targets[n] < mdl->n_polys) {
+            n++;
+        }
+    }
+    if (argc == 2) {
+        for (i = 1; i <= 3; i++) {
+            targets[n++] = mdl->n_polys >> i;
+        }
+    }
+    qsort(targets, n, sizeof(int), by_count);
+
+    adj = alloc(mdl->n_verts, sizeof(struct ADJ));
+    gone = alloc(mdl->n_verts, sizeof(int));
+    locked = alloc(mdl->n_verts, sizeof(int));
+    err = alloc(mdl->n_verts, sizeof(int));
+    stamp = alloc(mdl->n_verts, sizeof(int));
+    dead = alloc(mdl->n_polys, sizeof(int));
+    n_alive = mdl->n_polys;
+    for (i = 0; i < mdl->n_polys; i++) {
+        for (j = 0; j < nverts(i); j++) {
+            adj_add(corner(i, j)[0], i);
+        }
+    }
+    find_locks();
+    for (i = 0; i < mdl->n_verts; i++) {
+        consider(i);
+    }
+
+    printf("%s: %d polygons, %d vertices\n",
+            argv[1], mdl->n_polys, mdl->n_verts);
+    for (i = 0; i < n; i++) {
+        simplify(targets[i]);
+        snprintf(name, sizeof(name), "%s_lod%d", argv[1], i + 1);
+        if (!save(name, &nv, &e)) {
+            return 1;
+        }
+        printf("%s: %d polygons, %d vertices, max error %d",
+                name, n_alive, nv, e);
+        if (n_alive > targets[i]) {
+            printf(" (wanted %d, nothing left to collapse)", targets[i]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -28,8 +28,160 @@ struct PL_TEX *PL_cur_tex = NULL;
 int PL_fov          = 9;
 int PL_raster_mode  = PL_FLAT;
 int PL_cull_mode    = PL_CULL_BACK;
+int PL_lazy_xf      = 0;
 
-static int tmp_vertices[PL_MAX_OBJ_V];
+int PL_lod_polygons[PL_MAX_LODS + 1];
+int PL_lod_saved    = 0;
+
+/* a finer level is only picked again once the object is this much
+ * (as a shift of the threshold) bigger, so it doesn't pop back and
+ * forth at the threshold */
+#define LOD_HYST_SHIFT 3
+
+/* scratch space for the vertices of the object being rendered,
+ * grown to the largest object seen so far */
+static int *tmp_vertices = NULL;
+/* screen space [X,Y,1/Z] of tmp_vertices, filled in by PL_outcodes */
+static int *tmp_proj = NULL;
+static int tmp_cap = 0; /* vertices there is room for */
+
+/* lazy transform state of the object being rendered. a vertex of
+ * tmp_vertices is valid once its stamp matches the current generation */
+static unsigned *tmp_stamp = NULL;
+static unsigned xf_gen = 0;
+static struct PL_OBJ *lz_obj;
+static int lz_on; /* lazy transform is used for the object being rendered */
+
+/* view space vertices and projections of the object being rendered,
+ * tmp_vertices and tmp_proj or the object's own vertex cache */
+static int *cur_verts;
+static int *cur_proj;
+
+/* camera in the object space of the object being rendered, shortened
+ * by eye_shift bits. eye_sign is 0 if there is none */
+static int obj_eye[3];
+static int eye_shift;
+static int eye_sign;
+
+/* make room for n vertices in the scratch space, returns 0 if
+ * there is no memory for it */
+static int
+reserve_tmp(int n)
+{
+    if (n <= tmp_cap) {
+        return 1;
+    }
+    if (tmp_vertices) {
+        EXT_free(tmp_vertices);
+        EXT_free(tmp_proj);
+        EXT_free(tmp_stamp);
+    }
+    tmp_cap = 0;
+    tmp_vertices = EXT_calloc(n * PL_VLEN, sizeof(int));
+    tmp_proj = EXT_calloc(n * PL_VLEN, sizeof(int));
+    /* zero is never a current generation */
+    tmp_stamp = EXT_calloc(n, sizeof(unsigned));
+    if (!tmp_vertices || !tmp_proj || !tmp_stamp) {
+        EXT_error(PL_ERR_NO_MEM, "objmgr", "no memory");
+        return 0;
+    }
+    tmp_cap = n;
+    return 1;
+}
+
+/* transform, outcode and project a vertex the first time it is used */
+static void
+lazy_xf(int index)
+{
+    int *v;
+
+    if (tmp_stamp[index] == xf_gen) {
+        return;
+    }
+    tmp_stamp[index] = xf_gen;
+    v = &tmp_vertices[index * PL_VLEN];
+    PL_mst_xf_modelview_vec(&lz_obj->verts[index * PL_VLEN], v, 1);
+    PL_outcodes(v, &tmp_proj[index * PL_VLEN], 1);
+}
+
+/* shift v right until all of it is within [-lim, lim],
+ * returns the number of bits shifted out */
+static int
+shorten(int *v, int lim)
+{
+    int s = 0;
+
+    while (v[0] > lim || v[0] < -lim ||
+           v[1] > lim || v[1] < -lim ||
+           v[2] > lim || v[2] < -lim) {
+        v[0] >>= 1;
+        v[1] >>= 1;
+        v[2] >>= 1;
+        s++;
+    }
+    return s;
+}
+
+/* back face test of a polygon with a known plane against obj_eye,
+ * returns 1 if the polygon faces away. it can only disagree with the
+ * view space test for polygons that are seen almost edge on */
+static int
+obj_back_face(struct PL_POLY *poly)
+{
+    int *p = poly->plane;
+
+    return ((p[0] * obj_eye[0] + p[1] * obj_eye[1] + p[2] * obj_eye[2] -
+            (p[3] >> eye_shift)) * eye_sign) < 0;
+}
+
+/* visibility of a cluster of an object that is vis as a whole,
+ * PL_VIS_OUTSIDE if it is off screen or all of it faces away */
+static int
+cluster_vis(struct PL_CLUSTER *cl, int vis)
+{
+    int sph[4], w[3];
+    int *a = cl->cone;
+    int i, r, dw, t, sn;
+
+    if (vis != PL_VIS_INSIDE) {
+        PL_mst_xf_sphere(cl->bsphere, sph);
+        vis = PL_sphere_frustum_test(sph);
+        if (vis == PL_VIS_OUTSIDE) {
+            return vis;
+        }
+    }
+    if (a[3] <= 0 || eye_sign == 0 || PL_cull_mode == PL_CULL_NONE) {
+        return vis;
+    }
+    /* every polygon faces away if every normal in the cone points away
+     * from the eye by more than the radius of the sphere. with w from
+     * the eye to the center, the least any of them does is
+     * |w| * cos(angle of w to the axis + half angle of the cone) */
+    for (i = 0; i < 3; i++) {
+        w[i] = (cl->bsphere[i] >> eye_shift) - obj_eye[i];
+    }
+    r = (cl->bsphere[3] >> eye_shift) + 2;
+    r = (r >> shorten(w, 16383)) +
+        ((abs(w[0]) + abs(w[1]) + abs(w[2])) >> 12) + 1;
+    if (r > 16383) {
+        return vis;
+    }
+    dw = (a[0] * w[0] + a[1] * w[1] + a[2] * w[2]) >> 14;
+    /* back faces are on the other side of a mirrored object,
+     * front faces on the other side of back faces */
+    if ((eye_sign < 0) != (PL_cull_mode == PL_CULL_FRONT)) {
+        dw = -dw;
+    }
+    if (dw <= r) {
+        return vis;
+    }
+    t  = PL_isqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2] - dw * dw);
+    sn = PL_isqrt((1 << 28) - a[3] * a[3]) + 1;
+    if (dw * a[3] - t * sn > (r << 14)) {
+        return PL_VIS_OUTSIDE;
+    }
+    return vis;
+}
 
 static void
 load_stream(int *dst, int *src, int dim, int len, int *minz, int *maxz)
@@ -41,7 +193,7 @@ load_stream(int *dst, int *src, int dim, int len, int *minz, int *maxz)
     while (len--) {
         index = src[0];
         /* index into object vertex array */
-        memcpy(dst, &tmp_vertices[index * PL_VLEN], sizeof(int) * 3);
+        memcpy(dst, &cur_verts[index * PL_VLEN], sizeof(int) * 3);
         z = dst[2];
         if (z > lmaxz) lmaxz = z;
         if (z < lminz) lminz = z;
@@ -57,8 +209,29 @@ load_stream(int *dst, int *src, int dim, int len, int *minz, int *maxz)
     *maxz = lmaxz;
 }
 
+/* like load_stream followed by PL_psp_project, for polygons that
+ * have all of their vertices in cur_proj */
+static void
+load_proj(int *dst, int *src, int dim, int len)
+{
+    int *p;
+
+    while (len--) {
+        p = &cur_proj[src[0] * PL_VLEN];
+        dst[0] = p[0];
+        dst[1] = p[1];
+        dst[2] = p[2];
+        if (dim == PL_STREAM_TEX) {
+            dst[3] = src[1] << PL_TP;
+            dst[4] = src[2] << PL_TP;
+        }
+        src += 3;
+        dst += dim;
+    }
+}
+
 static void
-e_render_polygon(struct PL_POLY *poly)
+e_render_polygon(struct PL_POLY *poly, int vis)
 {
     int minz, maxz; /* z extents for frustum testing */
     int res; /* result of frustum test */
@@ -67,6 +240,8 @@ e_render_polygon(struct PL_POLY *poly)
     struct PL_TEX *tex = PL_cur_tex;
     int *clipped;
     int back_face;
+    int i, oc, oc_and, oc_or; /* outcodes */
+    int *v;
     
     int resv[(PL_MAX_POLY_VERTS * PL_VDIM) * 3];
     int *copy = resv + (0 * (PL_MAX_POLY_VERTS * PL_VDIM));
@@ -74,6 +249,36 @@ e_render_polygon(struct PL_POLY *poly)
     int *proj = resv + (2 * (PL_MAX_POLY_VERTS * PL_VDIM));
 
     nedge = poly->n_verts & 0xf;
+
+    /* cull against the polygon's plane before touching any vertex,
+     * the view space test is left for polygons without one */
+    back_face = -1;
+    if (PL_cull_mode != PL_CULL_NONE && eye_sign &&
+            (poly->plane[0] | poly->plane[1] | poly->plane[2])) {
+        back_face = obj_back_face(poly);
+        if ((back_face + 1) & PL_cull_mode) {
+            return;
+        }
+    }
+
+    if (lz_on) {
+        for (i = 0; i <= nedge; i++) {
+            lazy_xf(poly->verts[i * PL_POLY_VLEN]);
+        }
+    }
+
+    /* outcodes were computed in the transform pass */
+    oc_and = PL_OC_OUT;
+    oc_or  = 0;
+    for (i = 0; i < nedge; i++) {
+        oc = cur_verts[poly->verts[i * PL_POLY_VLEN] * PL_VLEN + 3];
+        oc_and &= oc;
+        oc_or  |= oc;
+    }
+    if (oc_and) {
+        return; /* all vertices outside of the same plane */
+    }
+
     rmode = PL_raster_mode;
     
     switch (rmode) {
@@ -81,7 +286,7 @@ e_render_polygon(struct PL_POLY *poly)
             if (tex == NULL) {
                 tex = poly->tex;
             }
-            if (tex != NULL && tex->data) {
+            if (tex != NULL && (tex->data || tex->bc)) {
                 stype = PL_STREAM_TEX;
                 break;
             }
@@ -96,31 +301,60 @@ e_render_polygon(struct PL_POLY *poly)
             return; /* bad raster mode */
     }
     
-    load_stream(copy, poly->verts, stype, nedge + 1, &minz, &maxz);
-    res = PL_frustum_test(minz, maxz);
+    if (!(oc_or & PL_OC_NOPROJ)) {
+        /* every vertex is in front of the near plane and was projected
+         * by the outcode pass, assemble the stream from there */
+        v = poly->verts;
+        if (back_face < 0) {
+            back_face = PL_winding_order(
+                    &cur_verts[v[0 * PL_POLY_VLEN] * PL_VLEN],
+                    &cur_verts[v[1 * PL_POLY_VLEN] * PL_VLEN],
+                    &cur_verts[v[2 * PL_POLY_VLEN] * PL_VLEN]);
+            if ((back_face + 1) & PL_cull_mode) {
+                return;
+            }
+        }
+        load_proj(proj, v, stype, nedge + 1);
+    } else {
+        load_stream(copy, poly->verts, stype, nedge + 1, &minz, &maxz);
+        if (vis == PL_VIS_INSIDE) {
+            /* whole object is past the near plane */
+            res = PL_Z_OUTC_IN_VIEW;
+        } else {
+            res = PL_frustum_test(minz, maxz);
+            if (res == PL_Z_OUTC_OUTSIDE) {
+                return;
+            }
+        }
 
-    if (res == PL_Z_OUTC_OUTSIDE) {
-        return;
-    }
+        if (back_face < 0) {
+            /* test winding order in view space rather than screen space */
+            back_face = PL_winding_order(copy, copy + stype,
+                                         copy + stype * 2);
+            if ((back_face + 1) & PL_cull_mode) {
+                return;
+            }
+        }
 
-    /* test winding order in view space rather than screen space */
-    back_face = PL_winding_order(copy, copy + stype, copy + stype * 2);
-    
-    if ((back_face + 1) & PL_cull_mode) {
-        return;
+        if (res == PL_Z_OUTC_PART_NZ) {
+            clipped = clip;
+            nedge = PL_clip_poly_nz(clipped, copy, stype, nedge);
+        } else {
+            clipped = copy;
+        }
+
+        PL_psp_project(clipped, proj, stype, nedge + 1, PL_fov);
     }
-    
-    if (res == PL_Z_OUTC_PART_NZ) {
-        clipped = clip;
-        nedge = PL_clip_poly_nz(clipped, copy, stype, nedge);
-    } else {
-        clipped = copy;
+    if (oc_or == 0) {
+        nedge |= PL_NOCLIP;
     }
     
-    PL_psp_project(clipped, proj, stype, nedge + 1, PL_fov);
-    
     if (rmode == PL_TEXTURED) {
-        PL_lintx_poly(proj, nedge, tex->data);
+        if (tex->bc) {
+            PL_bctx_poly(proj, nedge, tex->bc);
+        } else {
+            PL_lintx_poly(proj, nedge, tex->data);
+        }
     } else {
         PL_flat_poly(proj, nedge, poly->color);
     }
@@ -144,24 +378,309 @@ PL_xfproj_vert(int *in, int *out)
     return (cnd == PL_Z_OUTC_IN_VIEW);
 }
 
+/* level of detail for a view space bounding sphere of obj,
+ * starting from level lvl that was drawn before */
+static int
+pick_lod(struct PL_OBJ *obj, int *sph, int lvl)
+{
+    int r, px;
+
+    if (sph[2] <= PL_Z_NEAR_PLANE || sph[3] >= (INT_MAX >> PL_fov)) {
+        return 0; /* too close to tell, full detail */
+    }
+    /* radius in pixels, the same scale PL_psp_project uses */
+    r = (sph[3] << PL_fov) / sph[2];
+    if (lvl > obj->n_lods) {
+        lvl = obj->n_lods;
+    }
+    while (lvl < obj->n_lods && r < obj->lod_px[lvl]) {
+        lvl++;
+    }
+    while (lvl > 0) {
+        px = obj->lod_px[lvl - 1];
+        if (r <= px + (px >> LOD_HYST_SHIFT)) {
+            break;
+        }
+        lvl--;
+    }
+    return lvl;
+}
+
+extern void
+PL_add_lod(struct PL_OBJ *obj, struct PL_OBJ *lvl, int px)
+{
+    if (!obj || !lvl) {
+        return;
+    }
+    if (obj->n_lods >= PL_MAX_LODS) {
+        EXT_error(PL_ERR_MISC, "objmgr", "too many levels of detail");
+        return;
+    }
+    obj->lod[obj->n_lods] = lvl;
+    obj->lod_px[obj->n_lods] = px;
+    obj->n_lods++;
+}
+
+/* 1 if obj's vertex cache was made under the current state,
+ * otherwise the key is updated for the caller to fill it in */
+static int
+vcache_hit(struct PL_OBJ *obj)
+{
+    int key[PL_VC_KEY_LEN];
+    int m[16];
+    int i, j;
+
+    PL_mst_get_mv(m);
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 3; j++) {
+            key[i * 3 + j] = m[i * 4 + j];
+        }
+    }
+    key[12] = PL_fov;
+    key[13] = PL_vp_min_x;
+    key[14] = PL_vp_max_x;
+    key[15] = PL_vp_min_y;
+    key[16] = PL_vp_max_y;
+    key[17] = PL_vp_cen_x;
+    key[18] = PL_vp_cen_y;
+    if (obj->vc_valid && !memcmp(key, obj->vc_key, sizeof(key))) {
+        return 1;
+    }
+    memcpy(obj->vc_key, key, sizeof(key));
+    obj->vc_valid = 1;
+    return 0;
+}
+
+/* draw level lvl of full at the current matrix, vis is the result
+ * of the bounding sphere test of the full object */
+static void
+render_level(struct PL_OBJ *full, int lvl, int vis)
+{
+    int i, j, cvis;
+    int sph[4];
+    struct PL_CLUSTER *cl;
+    struct PL_OBJ *obj;
+
+    obj = full;
+    if (lvl > 0) {
+        obj = obj->lod[lvl - 1];
+        if (obj->bsphere[3] > 0 && vis == PL_VIS_INSIDE) {
+            /* the level may reach past the full object */
+            PL_mst_xf_sphere(obj->bsphere, sph);
+            vis = PL_sphere_frustum_test(sph);
+            if (vis == PL_VIS_OUTSIDE) {
+                return;
+            }
+        } else if (vis == PL_VIS_INSIDE) {
+            vis = PL_VIS_PARTIAL;
+        }
+    }
+    PL_lod_polygons[lvl] += obj->n_polys;
+    PL_lod_saved += full->n_polys - obj->n_polys;
+
+    if (!reserve_tmp(obj->n_verts)) {
+        return;
+    }
+
+    eye_sign = PL_mst_eye(obj_eye);
+    eye_shift = shorten(obj_eye, 32767);
+
+    lz_on = PL_lazy_xf && !obj->vcache;
+    cur_verts = tmp_vertices;
+    cur_proj = tmp_proj;
+    if (obj->vcache) {
+        cur_verts = obj->vcache;
+        cur_proj = obj->vcache + obj->n_verts * PL_VLEN;
+    }
+    if (lz_on) {
+        /* vertices are done by e_render_polygon */
+        lz_obj = obj;
+        if (++xf_gen == 0) {
+            memset(tmp_stamp, 0, tmp_cap * sizeof(unsigned));
+            xf_gen = 1;
+        }
+    } else if (!obj->vcache || !vcache_hit(obj)) {
+        if (obj->soa) {
+            PL_mst_xf_modelview_soa(obj->soa, cur_verts, obj->n_verts);
+        } else {
+            PL_mst_xf_modelview_vec(obj->verts, cur_verts, obj->n_verts);
+        }
+        PL_outcodes(cur_verts, cur_proj, obj->n_verts);
+    }
+
+    if (obj->clusters) {
+        for (i = 0; i < obj->n_clusters; i++) {
+            cl = &obj->clusters[i];
+            cvis = cluster_vis(cl, vis);
+            if (cvis == PL_VIS_OUTSIDE) {
+                continue;
+            }
+            for (j = cl->first; j < cl->first + cl->n_polys; j++) {
+                e_render_polygon(&obj->polys[j], cvis);
+            }
+        }
+        return;
+    }
+    for (i = 0; i < obj->n_polys; i++) {
+        e_render_polygon(&obj->polys[i], vis);
+    }
+}
+
+/* fold the textures of obj's polygons into the frame signature */
+static void
+probe_texes(struct PL_OBJ *obj)
+{
+    int i, t;
+
+    for (i = 0; i < obj->n_polys; i++) {
+        t = (int) (size_t) obj->polys[i].tex;
+        PL_probe_fold(&t, 1);
+    }
+}
+
+/* fold what drawing obj under the current matrices depends on into
+ * the frame signature */
+static void
+probe_object(struct PL_OBJ *obj)
+{
+    int st[16];
+    int lvl;
+
+    PL_mst_get_mv(st);
+    PL_probe_fold(st, 16);
+    /* the level this frame would pick, lod_cur is the last one drawn */
+    lvl = 0;
+    if (obj->n_lods > 0 && obj->bsphere[3] > 0) {
+        PL_mst_xf_sphere(obj->bsphere, st);
+        lvl = pick_lod(obj, st, obj->lod_cur);
+    }
+    st[0] = (int) (size_t) obj;
+    st[1] = obj->n_verts;
+    st[2] = obj->n_polys;
+    st[3] = lvl;
+    st[4] = PL_fov;
+    st[5] = PL_raster_mode;
+    st[6] = PL_cull_mode;
+    st[7] = PL_vp_min_x;
+    st[8] = PL_vp_min_y;
+    st[9] = PL_vp_max_x;
+    st[10] = PL_vp_max_y;
+    st[11] = PL_vp_cen_x;
+    st[12] = PL_vp_cen_y;
+    st[13] = (int) (size_t) PL_cur_tex;
+    PL_probe_fold(st, 14);
+    probe_texes(lvl > 0 ? obj->lod[lvl - 1] : obj);
+}
+
 extern void
 PL_render_object(struct PL_OBJ *obj)
 {
-    int i;
+    int vis, lvl;
+    int sph[4];
 
     if (!obj) {
         return;
     }
+    if (PL_probe) {
+        probe_object(obj);
+        return;
+    }
 
-    if (obj->n_verts >= PL_MAX_OBJ_V) {
-        EXT_error(PL_ERR_MISC, "objmgr", "too many object vertices!");
+    vis = PL_VIS_PARTIAL;
+    lvl = 0;
+    if (obj->bsphere[3] > 0) {
+        PL_mst_xf_sphere(obj->bsphere, sph);
+        vis = PL_sphere_frustum_test(sph);
+        if (vis == PL_VIS_OUTSIDE) {
+            return;
+        }
+        if (obj->n_lods > 0) {
+            lvl = pick_lod(obj, sph, obj->lod_cur);
+            obj->lod_cur = lvl;
+        }
     }
+    render_level(obj, lvl, vis);
+}
 
-    PL_mst_xf_modelview_vec(obj->verts, tmp_vertices, obj->n_verts);
+/* [matrix index, vis, level] of each instance that passed culling */
+static int *inst_list = NULL;
+static int inst_cap = 0;
 
-    for (i = 0; i < obj->n_polys; i++) {
-        e_render_polygon(&obj->polys[i]);
+extern void
+PL_render_instances(struct PL_OBJ *obj, int *mats, int count)
+{
+    int base[16];
+    int i, n, nv, vis, lvl;
+    int sph[4];
+    int *e;
+
+    if (!obj || !mats || count <= 0) {
+        return;
+    }
+    if (PL_probe) {
+        PL_probe_fold(mats, count * 16);
+        probe_object(obj);
+        /* each instance may draw a different level */
+        for (i = 0; i < obj->n_lods; i++) {
+            probe_texes(obj->lod[i]);
+        }
+        return;
+    }
+    /* scratch space for the largest level, once for all of them */
+    nv = obj->n_verts;
+    for (i = 0; i < obj->n_lods; i++) {
+        if (obj->lod[i]->n_verts > nv) {
+            nv = obj->lod[i]->n_verts;
+        }
+    }
+    if (!reserve_tmp(nv)) {
+        return;
+    }
+    if (count > inst_cap) {
+        if (inst_list) {
+            EXT_free(inst_list);
+        }
+        inst_cap = 0;
+        inst_list = EXT_calloc(count * 3, sizeof(int));
+        if (inst_list == NULL) {
+            EXT_error(PL_ERR_NO_MEM, "objmgr", "no memory");
+            return;
+        }
+        inst_cap = count;
+    }
+
+    PL_mst_get(base);
+    PL_mst_push();
+    /* cull all of them before drawing any */
+    n = 0;
+    for (i = 0; i < count; i++) {
+        vis = PL_VIS_PARTIAL;
+        lvl = 0;
+        if (obj->bsphere[3] > 0) {
+            PL_mst_load(base);
+            PL_mst_mul(mats + i * 16);
+            PL_mst_xf_sphere(obj->bsphere, sph);
+            vis = PL_sphere_frustum_test(sph);
+            if (vis == PL_VIS_OUTSIDE) {
+                continue;
+            }
+            if (obj->n_lods > 0) {
+                lvl = pick_lod(obj, sph, 0);
+            }
+        }
+        e = inst_list + n * 3;
+        e[0] = i;
+        e[1] = vis;
+        e[2] = lvl;
+        n++;
+    }
+    for (i = 0; i < n; i++) {
+        e = inst_list + i * 3;
+        PL_mst_load(base);
+        PL_mst_mul(mats + e[0] * 16);
+        render_level(obj, e[2], e[1]);
     }
+    PL_mst_pop();
 }
 
 extern void
@@ -179,6 +698,26 @@ PL_delete_object(struct PL_OBJ *obj)
     obj->verts   = NULL;
     obj->n_verts = 0;
     
+    if (obj->soa) {
+        EXT_free(obj->soa);
+    }
+    obj->soa = NULL;
+    if (obj->vcache) {
+        EXT_free(obj->vcache);
+    }
+    obj->vcache   = NULL;
+    obj->vc_valid = 0;
+    if (obj->clusters) {
+        EXT_free(obj->clusters);
+    }
+    obj->clusters   = NULL;
+    obj->n_clusters = 0;
+    memset(obj->lod, 0, sizeof(obj->lod));
+    obj->n_lods  = 0;
+    obj->lod_cur = 0;
+    memset(obj->bsphere, 0, sizeof(obj->bsphere));
+    memset(obj->bbox, 0, sizeof(obj->bbox));
+
     if (obj->polys) {
         for (i = 0; i < obj->n_polys; i++) {
             obj->polys[i].color   = 0;
@@ -232,6 +771,528 @@ PL_copy_object(struct PL_OBJ *dst, struct PL_OBJ *src)
         dst->polys   = NULL;
         dst->n_polys = 0;
     }
+    if (src->soa) {
+        PL_soa_object(dst);
+    }
+    if (src->vcache) {
+        PL_cache_object(dst);
+    }
+    memcpy(dst->bsphere, src->bsphere, sizeof(dst->bsphere));
+    memcpy(dst->bbox, src->bbox, sizeof(dst->bbox));
+    if (src->n_clusters > 0) {
+        size = src->n_clusters * sizeof(struct PL_CLUSTER);
+        dst->clusters = EXT_calloc(1, size);
+        if (dst->clusters == NULL) {
+            EXT_error(PL_ERR_NO_MEM, "objmgr", "no memory");
+            return;
+        }
+        memcpy(dst->clusters, src->clusters, size);
+        dst->n_clusters = src->n_clusters;
+    }
+    memcpy(dst->lod, src->lod, sizeof(dst->lod));
+    memcpy(dst->lod_px, src->lod_px, sizeof(dst->lod_px));
+    dst->n_lods = src->n_lods;
+}
+
+/* number of ints in the soa array of an object with n vertices */
+#define SOA_INTS(n) ((((n) + PL_SOA_BLK - 1) / PL_SOA_BLK) * PL_SOA_BLK * 3)
+
+extern void
+PL_soa_object(struct PL_OBJ *obj)
+{
+    int i, j, *blk, *v;
+
+    if (!obj) {
+        return;
+    }
+    if (obj->soa) {
+        EXT_free(obj->soa);
+        obj->soa = NULL;
+    }
+    if (obj->n_verts <= 0) {
+        return;
+    }
+    /* calloc so the padding at the end of the last block is zero */
+    obj->soa = EXT_calloc(SOA_INTS(obj->n_verts), sizeof(int));
+    if (obj->soa == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "objmgr", "no memory");
+        return;
+    }
+    for (i = 0; i < obj->n_verts; i++) {
+        blk = obj->soa + (i / PL_SOA_BLK) * PL_SOA_BLK * 3;
+        j = i % PL_SOA_BLK;
+        v = obj->verts + i * PL_VLEN;
+        blk[j]                  = v[0];
+        blk[j + PL_SOA_BLK]     = v[1];
+        blk[j + PL_SOA_BLK * 2] = v[2];
+    }
+}
+
+extern void
+PL_cache_object(struct PL_OBJ *obj)
+{
+    if (!obj) {
+        return;
+    }
+    if (obj->vcache) {
+        EXT_free(obj->vcache);
+        obj->vcache = NULL;
+    }
+    obj->vc_valid = 0;
+    if (obj->n_verts <= 0) {
+        return;
+    }
+    /* view space vertices, then their projections */
+    obj->vcache = EXT_calloc(obj->n_verts * PL_VLEN * 2, sizeof(int));
+    if (obj->vcache == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "objmgr", "no memory");
+    }
+}
+
+extern void
+PL_calc_bounds(struct PL_OBJ *obj)
+{
+    int i, j, l, r;
+    int d[3];
+    int *v;
+
+    if (!obj) {
+        return;
+    }
+    memset(obj->bsphere, 0, sizeof(obj->bsphere));
+    memset(obj->bbox, 0, sizeof(obj->bbox));
+    if (obj->n_verts <= 0) {
+        return;
+    }
+    for (j = 0; j < 3; j++) {
+        obj->bbox[j]     = INT_MAX;
+        obj->bbox[j + 3] = INT_MIN;
+    }
+    for (i = 0; i < obj->n_verts; i++) {
+        v = obj->verts + i * PL_VLEN;
+        for (j = 0; j < 3; j++) {
+            if (v[j] < obj->bbox[j])     obj->bbox[j]     = v[j];
+            if (v[j] > obj->bbox[j + 3]) obj->bbox[j + 3] = v[j];
+        }
+    }
+    /* sphere around the center of the box */
+    for (j = 0; j < 3; j++) {
+        obj->bsphere[j] = (obj->bbox[j] + obj->bbox[j + 3]) / 2;
+    }
+    r = 1; /* never 0, that means no bounds */
+    for (i = 0; i < obj->n_verts; i++) {
+        v = obj->verts + i * PL_VLEN;
+        for (j = 0; j < 3; j++) {
+            d[j] = v[j] - obj->bsphere[j];
+        }
+        l = PL_vec_len(d);
+        if (l > r) {
+            r = l;
+        }
+    }
+    obj->bsphere[3] = r;
+}
+
+extern void
+PL_calc_planes(struct PL_OBJ *obj)
+{
+    int i, j, m, lim;
+    int e1[3], e2[3];
+    int *a, *b, *c, *p;
+    struct PL_POLY *poly;
+
+    if (!obj) {
+        return;
+    }
+    for (i = 0; i < obj->n_polys; i++) {
+        poly = &obj->polys[i];
+        p = poly->plane;
+        a = &obj->verts[poly->verts[0 * PL_POLY_VLEN] * PL_VLEN];
+        b = &obj->verts[poly->verts[1 * PL_POLY_VLEN] * PL_VLEN];
+        c = &obj->verts[poly->verts[2 * PL_POLY_VLEN] * PL_VLEN];
+        for (j = 0; j < 3; j++) {
+            e1[j] = b[j] - a[j];
+            e2[j] = c[j] - a[j];
+        }
+        shorten(e1, 16383);
+        shorten(e2, 16383);
+        p[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        p[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        p[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        /* small enough that p . eye - p[3] in obj_back_face can't
+         * overflow, the shortened eye is within 32767 */
+        m = 1;
+        for (j = 0; j < 3; j++) {
+            if (a[j] > m) { m = a[j]; }
+            if (-a[j] > m) { m = -a[j]; }
+        }
+        lim = 0;
+        if (m <= (INT_MAX / 3) - 32767) {
+            lim = (INT_MAX / 3) / (m + 32767);
+        }
+        if (lim > 8191) {
+            lim = 8191;
+        }
+        if (lim == 0) {
+            /* too far out, leave it to the view space test */
+            p[0] = p[1] = p[2] = p[3] = 0;
+            continue;
+        }
+        shorten(p, lim);
+        p[3] = p[0] * a[0] + p[1] * a[1] + p[2] * a[2];
+    }
+}
+
+/* sort key of a polygon for PL_cluster_object */
+struct CL_KEY {
+    int axis; /* which way the normal points, one of 24 */
+    unsigned code; /* morton code of the center */
+    int index;
+};
+
+static int
+cmp_cl_key(const void *a, const void *b)
+{
+    const struct CL_KEY *ka = a;
+    const struct CL_KEY *kb = b;
+
+    if (ka->axis != kb->axis) {
+        return ka->axis - kb->axis;
+    }
+    if (ka->code != kb->code) {
+        return (ka->code < kb->code) ? -1 : 1;
+    }
+    return ka->index - kb->index;
+}
+
+/* spread the low 10 bits of x out to every third bit */
+static unsigned
+spread3(unsigned x)
+{
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8))  & 0x0300f00f;
+    x = (x | (x << 4))  & 0x030c30c3;
+    x = (x | (x << 2))  & 0x09249249;
+    return x;
+}
+
+/* bounding sphere and normal cone of a cluster */
+static void
+cluster_bounds(struct PL_OBJ *obj, struct PL_CLUSTER *cl)
+{
+    struct PL_POLY *poly;
+    int bb[6], u[3], sum[3], d[3];
+    int i, j, k, l, r, c, minc;
+    int *v, *n;
+
+    for (j = 0; j < 3; j++) {
+        bb[j]     = INT_MAX;
+        bb[j + 3] = INT_MIN;
+        sum[j]    = 0;
+    }
+    for (i = cl->first; i < cl->first + cl->n_polys; i++) {
+        poly = &obj->polys[i];
+        for (k = 0; k < (poly->n_verts & 0xf); k++) {
+            v = &obj->verts[poly->verts[k * PL_POLY_VLEN] * PL_VLEN];
+            for (j = 0; j < 3; j++) {
+                if (v[j] < bb[j])     bb[j]     = v[j];
+                if (v[j] > bb[j + 3]) bb[j + 3] = v[j];
+            }
+        }
+        n = poly->plane;
+        l = PL_vec_len(n);
+        if (l) {
+            for (j = 0; j < 3; j++) {
+                sum[j] += n[j] * 16384 / l;
+            }
+        }
+    }
+    for (j = 0; j < 3; j++) {
+        cl->bsphere[j] = (bb[j] + bb[j + 3]) / 2;
+    }
+    r = 1;
+    for (i = cl->first; i < cl->first + cl->n_polys; i++) {
+        poly = &obj->polys[i];
+        for (k = 0; k < (poly->n_verts & 0xf); k++) {
+            v = &obj->verts[poly->verts[k * PL_POLY_VLEN] * PL_VLEN];
+            for (j = 0; j < 3; j++) {
+                d[j] = v[j] - cl->bsphere[j];
+            }
+            l = PL_vec_len(d);
+            if (l > r) {
+                r = l;
+            }
+        }
+    }
+    cl->bsphere[3] = r;
+
+    /* the axis is the average normal, the cone opens up to the one
+     * farthest from it. no cone if any is 90 degrees or more off */
+    memset(cl->cone, 0, sizeof(cl->cone));
+    shorten(sum, 32767);
+    l = PL_vec_len(sum);
+    if (l == 0) {
+        return;
+    }
+    for (j = 0; j < 3; j++) {
+        cl->cone[j] = sum[j] * 16384 / l;
+    }
+    minc = 16384;
+    for (i = cl->first; i < cl->first + cl->n_polys; i++) {
+        n = obj->polys[i].plane;
+        l = PL_vec_len(n);
+        if (l == 0) {
+            return; /* no plane, can only be culled on its own */
+        }
+        for (j = 0; j < 3; j++) {
+            u[j] = n[j] * 16384 / l;
+        }
+        c = (u[0] * cl->cone[0] + u[1] * cl->cone[1] +
+             u[2] * cl->cone[2]) >> 14;
+        if (c < minc) {
+            minc = c;
+        }
+    }
+    /* a little off for the rounding of the normals */
+    cl->cone[3] = (minc > 16) ? (minc - 16) : 0;
+}
+
+extern void
+PL_cluster_object(struct PL_OBJ *obj)
+{
+    struct CL_KEY *keys;
+    struct PL_POLY *polys, *poly;
+    struct PL_CLUSTER *cl;
+    int i, j, k, m, nv, ax;
+    int c[3], ext[3];
+    int *v, *n;
+
+    if (!obj) {
+        return;
+    }
+    if (obj->clusters) {
+        EXT_free(obj->clusters);
+        obj->clusters = NULL;
+    }
+    obj->n_clusters = 0;
+    if (obj->n_polys <= 0) {
+        return;
+    }
+    PL_calc_bounds(obj);
+    PL_calc_planes(obj);
+
+    keys = EXT_calloc(obj->n_polys, sizeof(struct CL_KEY));
+    polys = EXT_calloc(obj->n_polys, sizeof(struct PL_POLY));
+    /* at most one partly filled cluster per direction */
+    obj->clusters = EXT_calloc(obj->n_polys / PL_CLUSTER_SIZE + 24,
+                               sizeof(struct PL_CLUSTER));
+    if (keys == NULL || polys == NULL || obj->clusters == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "objmgr", "no memory");
+        return;
+    }
+
+    for (j = 0; j < 3; j++) {
+        ext[j] = obj->bbox[j + 3] - obj->bbox[j] + 1;
+    }
+    /* group by the way the polygons face, then by where they are */
+    for (i = 0; i < obj->n_polys; i++) {
+        poly = &obj->polys[i];
+        n = poly->plane;
+        ax = 0;
+        for (j = 1; j < 3; j++) {
+            if (abs(n[j]) > abs(n[ax])) {
+                ax = j;
+            }
+        }
+        /* the face of a cube the normal points at and the quadrant of
+         * that face, so no cluster has normals more than 90 degrees apart */
+        keys[i].axis = (ax * 2 + (n[ax] < 0)) * 4 +
+                       (n[(ax + 1) % 3] < 0) * 2 + (n[(ax + 2) % 3] < 0);
+        keys[i].index = i;
+
+        nv = poly->n_verts & 0xf;
+        c[0] = c[1] = c[2] = 0;
+        for (k = 0; k < nv; k++) {
+            v = &obj->verts[poly->verts[k * PL_POLY_VLEN] * PL_VLEN];
+            for (j = 0; j < 3; j++) {
+                c[j] += v[j] - obj->bbox[j];
+            }
+        }
+        for (j = 0; j < 3; j++) {
+            c[j] = (nv > 0) ? (c[j] / nv) : 0;
+            c[j] = (int) ((unsigned) c[j] * 1023u / (unsigned) ext[j]);
+        }
+        keys[i].code = spread3(c[0]) | (spread3(c[1]) << 1) |
+                       (spread3(c[2]) << 2);
+    }
+    qsort(keys, obj->n_polys, sizeof(struct CL_KEY), cmp_cl_key);
+
+    for (i = 0; i < obj->n_polys; i++) {
+        polys[i] = obj->polys[keys[i].index];
+    }
+    EXT_free(obj->polys);
+    obj->polys = polys;
+
+    /* cut each run of polygons facing the same way into clusters */
+    i = 0;
+    while (i < obj->n_polys) {
+        m = i;
+        while (m < obj->n_polys && (m - i) < PL_CLUSTER_SIZE &&
+               keys[m].axis == keys[i].axis) {
+            m++;
+        }
+        cl = &obj->clusters[obj->n_clusters++];
+        cl->first = i;
+        cl->n_polys = m - i;
+        cluster_bounds(obj, cl);
+        i = m;
+    }
+    EXT_free(keys);
+}
+
+/* 1 if the 3x3 part of m mirrors, its determinant is negative */
+static int
+mirrors(int *m)
+{
+    int r[9];
+    int i, d;
+
+    /* only the sign matters and scaling a column keeps it, so the
+     * columns are shortened until the products can't overflow */
+    for (i = 0; i < 3; i++) {
+        r[i * 3 + 0] = m[i * 4 + 0];
+        r[i * 3 + 1] = m[i * 4 + 1];
+        r[i * 3 + 2] = m[i * 4 + 2];
+        shorten(r + i * 3, 511);
+    }
+    d = r[0] * (r[4] * r[8] - r[5] * r[7]) -
+        r[1] * (r[3] * r[8] - r[5] * r[6]) +
+        r[2] * (r[3] * r[7] - r[4] * r[6]);
+    return d < 0;
+}
+
+/* merge n objects into dst in world space, nv and np are their total
+ * vertices and polygons. vertices that land on the same spot are welded */
+static void
+bake_batch(struct PL_OBJ *dst, struct PL_OBJ **objs, int *mats, int n,
+           int nv, int np)
+{
+    struct PL_OBJ *src;
+    struct PL_POLY *sp, *dp;
+    int *hash, *remap, *m, *v, *d;
+    int i, j, k, c, h, hsz, cnv, base, flip;
+    int w[3];
+
+    /* open addressing, entries are vertex index + 1 */
+    hsz = 1;
+    while (hsz < nv * 2) {
+        hsz <<= 1;
+    }
+    hash = EXT_calloc(hsz, sizeof(int));
+    remap = EXT_calloc(nv ? nv : 1, sizeof(int));
+    dst->verts = EXT_calloc(nv ? nv * PL_VLEN : 1, sizeof(int));
+    dst->polys = EXT_calloc(np ? np : 1, sizeof(struct PL_POLY));
+    if (!hash || !remap || !dst->verts || !dst->polys) {
+        EXT_error(PL_ERR_NO_MEM, "objmgr", "no memory");
+        return;
+    }
+    base = 0;
+    for (i = 0; i < n; i++) {
+        src = objs[i];
+        m = mats + i * 16;
+        for (j = 0; j < src->n_verts; j++) {
+            v = src->verts + j * PL_VLEN;
+            for (k = 0; k < 3; k++) {
+                w[k] = ((v[0] * m[0 + k] + v[1] * m[4 + k] +
+                         v[2] * m[8 + k] + (1 << (PL_P - 1))) >> PL_P) +
+                       m[12 + k];
+            }
+            h = (int) (((unsigned) w[0] * 73856093u ^
+                        (unsigned) w[1] * 19349663u ^
+                        (unsigned) w[2] * 83492791u) & (hsz - 1));
+            for (;;) {
+                if (hash[h] == 0) {
+                    d = dst->verts + dst->n_verts * PL_VLEN;
+                    d[0] = w[0];
+                    d[1] = w[1];
+                    d[2] = w[2];
+                    hash[h] = ++dst->n_verts;
+                    break;
+                }
+                d = dst->verts + (hash[h] - 1) * PL_VLEN;
+                if (d[0] == w[0] && d[1] == w[1] && d[2] == w[2]) {
+                    break;
+                }
+                h = (h + 1) & (hsz - 1);
+            }
+            remap[base + j] = hash[h] - 1;
+        }
+        /* a mirroring matrix turns polygons inside out,
+         * their corners are reversed so they still face out */
+        flip = mirrors(m);
+        for (j = 0; j < src->n_polys; j++) {
+            sp = &src->polys[j];
+            dp = &dst->polys[dst->n_polys++];
+            *dp = *sp;
+            cnv = sp->n_verts;
+            for (c = 0; c <= cnv; c++) {
+                k = c;
+                if (flip) {
+                    k = (c == cnv) ? (cnv - 1) : (cnv - 1 - c);
+                }
+                v = sp->verts + k * PL_POLY_VLEN;
+                d = dp->verts + c * PL_POLY_VLEN;
+                d[0] = remap[base + v[0]];
+                d[1] = v[1];
+                d[2] = v[2];
+            }
+        }
+        base += src->n_verts;
+    }
+    EXT_free(hash);
+    EXT_free(remap);
+    PL_calc_bounds(dst);
+    PL_calc_planes(dst);
+}
+
+extern struct PL_OBJ *
+PL_batch_objects(struct PL_OBJ **objs, int *mats, int count,
+                 int max_verts, int *n_batches)
+{
+    struct PL_OBJ *out;
+    int i, j, nb, nv, np;
+
+    *n_batches = 0;
+    if (!objs || !mats || count <= 0) {
+        return NULL;
+    }
+    if (max_verts <= 0) {
+        max_verts = INT_MAX;
+    }
+    /* at most one batch per object */
+    out = EXT_calloc(count, sizeof(struct PL_OBJ));
+    if (out == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "objmgr", "no memory");
+        return NULL;
+    }
+    nb = 0;
+    for (i = 0; i < count; i = j) {
+        nv = 0;
+        np = 0;
+        /* objects in order until the budget is full, an object that
+         * is over the budget by itself gets a batch of its own */
+        for (j = i; j < count; j++) {
+            if (j > i && nv + objs[j]->n_verts > max_verts) {
+                break;
+            }
+            nv += objs[j]->n_verts;
+            np += objs[j]->n_polys;
+        }
+        bake_batch(&out[nb++], objs + i, mats + i * 16, j - i, nv, np);
+    }
+    *n_batches = nb;
+    return out;
 }
 
 extern void
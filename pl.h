@@ -23,8 +23,21 @@
 extern "C" {
 #endif
 
-/* maximum possible horizontal or vertical resolution */
-#define PL_MAX_SCREENSIZE 2048
+/* maximum possible horizontal or vertical resolution,
+ * limited by the fixed point precision of scan conversion.
+ * the scan tables are sized by PL_init for the resolution in use */
+#define PL_MAX_SCREENSIZE 8191
+
+/* log2 of the tile dimension of the color and depth buffers.
+ * 0 keeps them linear (one scanline after another),
+ * 3 or 4 stores them as 8x8 or 16x16 pixel tiles.
+ *
+ * Tiled buffers are owned by PL, PL_present copies the image
+ * into the video memory given to PL_init in linear order.
+ */
+#ifndef PL_TILE_LOG
+#define PL_TILE_LOG 0
+#endif
 
 /*****************************************************************************/
 /********************************* CLIPPING **********************************/
@@ -60,6 +73,25 @@ extern int PL_clip_line_y(int **v0, int **v1, int len, int min, int max);
 extern int PL_clip_poly_x(int *dst, int *src, int len, int num);
 extern int PL_clip_poly_y(int *dst, int *src, int len, int num);
 
+/* view space vertex outcodes */
+#define PL_OC_NEAR         0x01  /* on or behind the near plane */
+#define PL_OC_LEFT         0x02  /* projects left of the viewport */
+#define PL_OC_RIGHT        0x04
+#define PL_OC_TOP          0x08
+#define PL_OC_BOTTOM       0x10
+#define PL_OC_OUT          0x1f  /* any of the above */
+#define PL_OC_CLIP         0x20  /* not safely inside, may need clipping */
+#define PL_OC_NOPROJ       0x40  /* vertex has no screen projection */
+
+/* compute the outcodes of 'num' view space vertices [X,Y,Z,W] of
+ * PL_VLEN integers each, the outcode is stored in W.
+ * polygons whose vertices share an outside bit can't be seen,
+ * polygons whose vertices all have an outcode of 0 need no clipping.
+ * if proj is not NULL the projected [X,Y,1/Z] of every vertex without
+ * PL_OC_NOPROJ is stored there, PL_VLEN integers apart, the same as
+ * PL_psp_project would give */
+extern void PL_outcodes(int *v, int *proj, int num);
+
 /* test point to determine if it's in front of near plane */
 extern int PL_point_frustum_test(int *v);
 /* test z bounds to determine its position relative to near plane */
@@ -67,13 +99,19 @@ extern int PL_frustum_test(int minz, int maxz);
 /* clip polygon to near plane */
 extern int PL_clip_poly_nz(int *dst, int *src, int len, int num);
 
+#define PL_VIS_OUTSIDE     0     /* completely outside the view frustum */
+#define PL_VIS_PARTIAL     1     /* crosses at least one frustum plane */
+#define PL_VIS_INSIDE      2     /* completely inside the view frustum */
+
+/* test a view space sphere [x, y, z, radius] against the six planes of
+ * the view frustum (near, far, and the sides given by PL_fov and the
+ * viewport). returns one of the PL_VIS_* values */
+extern int PL_sphere_frustum_test(int *s);
+
 /*****************************************************************************/
 /********************************** ENGINE ***********************************/
 /*****************************************************************************/
 
-/* maximum number of vertices in object */
-#define PL_MAX_OBJ_V  4096
-
 #define PL_FLAT       1
 #define PL_TEXTURED   0
 
@@ -89,6 +127,19 @@ extern int PL_fov; /* min valid value = 8 */
 extern struct PL_TEX *PL_cur_tex;
 extern int PL_raster_mode; /* PL_FLAT or PL_TEXTURED */
 extern int PL_cull_mode;
+/* nonzero to transform vertices as the polygons that use them are drawn,
+ * polygons culled by their plane never transform theirs.
+ * worth it for big closed meshes, off by default */
+extern int PL_lazy_xf;
+
+/* most lower levels of detail an object can have */
+#define PL_MAX_LODS   4
+
+/* polygons submitted at each level of detail, 0 is full detail,
+ * and how many fewer that is than drawing every object at full detail.
+ * not reset by PL, clear them each frame like PL_polygon_count */
+extern int PL_lod_polygons[PL_MAX_LODS + 1];
+extern int PL_lod_saved;
 
 struct PL_POLY {
     struct PL_TEX *tex;
@@ -99,21 +150,106 @@ struct PL_POLY {
     int verts[6 * PL_POLY_VLEN]; 
     int color;
     int n_verts;
+    /* object space plane [nx, ny, nz, d] through the first three vertices,
+     * normal shortened to 13 bits or less. filled in by PL_calc_planes,
+     * a zero normal means it is unknown and the polygon is culled
+     * in view space instead */
+    int plane[4];
+};
+
+/* most polygons in a cluster made by PL_cluster_object */
+#define PL_CLUSTER_SIZE 64
+
+/* a run of polygons of an object that face about the same way */
+struct PL_CLUSTER {
+    int first; /* index of its first polygon in PL_OBJ.polys */
+    int n_polys;
+    int bsphere[4]; /* object space center x, y, z, radius */
+    /* normal cone, unit axis x, y, z and the cosine of its half angle
+     * in 14 bit fixed point. a cosine of 0 means it can't be culled
+     * as back facing */
+    int cone[4];
 };
 
+/* vertices per block of the structure-of-arrays layout */
+#define PL_SOA_BLK    16
+
+/* the model+view and projection state an object's vertex cache is for */
+#define PL_VC_KEY_LEN 19
+
 struct PL_OBJ {
     struct PL_POLY *polys; /* list of polygons in the object */
     int *verts; /* array of [x, y, z, 0] values */
+    /* optional copy of verts in blocks of PL_SOA_BLK x's, y's, then z's.
+     * created by PL_soa_object (call it again after changing verts),
+     * transformed faster when present */
+    int *soa;
+    /* optional cache of the view space vertices and their projections,
+     * made by PL_cache_object. they are only transformed again when
+     * the model+view or the projection changed since the last time */
+    int *vcache;
+    int  vc_key[PL_VC_KEY_LEN];
+    int  vc_valid;
     int  n_polys;
     int  n_verts;
+    /* object space bounds, filled in by PL_calc_bounds.
+     * a radius of 0 means the object has no bounds and is never culled */
+    int  bsphere[4]; /* center x, y, z, radius */
+    int  bbox[6]; /* min x, y, z, max x, y, z */
+    /* optional, made by PL_cluster_object */
+    struct PL_CLUSTER *clusters;
+    int  n_clusters;
+    /* optional lower levels of detail, added with PL_add_lod. lod[i] is
+     * drawn while the bounding sphere is under lod_px[i] pixels in
+     * radius on screen. levels are shared, not copied or deleted */
+    struct PL_OBJ *lod[PL_MAX_LODS];
+    int  lod_px[PL_MAX_LODS];
+    int  n_lods;
+    int  lod_cur; /* level drawn last time, 0 is this object */
 };
 
 /* take an XYZ coord in world space and convert to screen space */
 extern int  PL_xfproj_vert(int *in, int *out);
 
 extern void PL_render_object(struct PL_OBJ *obj);
+/* draw obj count times, mats holds count 4x4 matrices that are each
+ * multiplied onto the current top of the matrix stack like PL_mst_mul.
+ * the same as pushing, multiplying and rendering each one, but all of
+ * them are culled first and the setup is done once. instances don't
+ * remember their level of detail, so they have no hysteresis */
+extern void PL_render_instances(struct PL_OBJ *obj, int *mats, int count);
+/* add a lower level of detail to obj, used while its bounding sphere
+ * projects to a radius under px pixels. add them from finest to
+ * coarsest with px getting smaller */
+extern void PL_add_lod(struct PL_OBJ *obj, struct PL_OBJ *lvl, int px);
 extern void PL_delete_object(struct PL_OBJ *obj);
 extern void PL_copy_object(struct PL_OBJ *dst, struct PL_OBJ *src);
+/* bake count static objects into world space under their 4x4 model
+ * matrices (mats holds count of them) and merge them into as few
+ * objects as fit in max_verts vertices each, 0 for no limit. vertices
+ * that end up in the same place are welded. returns an EXT_calloc'd
+ * array of *n_batches objects, free each with PL_delete_object and
+ * then the array with EXT_free */
+extern struct PL_OBJ *PL_batch_objects(struct PL_OBJ **objs, int *mats,
+                                       int count, int max_verts,
+                                       int *n_batches);
+/* build the structure-of-arrays vertex copy of an object */
+extern void PL_soa_object(struct PL_OBJ *obj);
+/* give an object a cache of its transformed vertices, for objects that
+ * are often drawn again with the same matrix and camera. call it again
+ * after changing verts */
+extern void PL_cache_object(struct PL_OBJ *obj);
+/* compute the bounding sphere and box of an object's vertices.
+ * done for you by PL_export, import_dmdl and PL_copy_object */
+extern void PL_calc_bounds(struct PL_OBJ *obj);
+/* compute the plane of every polygon of an object, used for back face
+ * culling in object space. done for you by PL_export and import_dmdl */
+extern void PL_calc_planes(struct PL_OBJ *obj);
+/* sort the polygons of an object into clusters of up to PL_CLUSTER_SIZE
+ * polygons that lie close together and face about the same way.
+ * PL_render_object then culls whole clusters before looking at their
+ * polygons. worth it for objects with thousands of polygons */
+extern void PL_cluster_object(struct PL_OBJ *obj);
 
 /*****************************************************************************/
 /*********************************** IMODE ***********************************/
@@ -163,19 +299,49 @@ extern struct PL_OBJ *PL_get_working_copy(void);
 #define PL_STREAM_FLAT       3  /* X Y Z */
 #define PL_STREAM_TEX        5  /* X Y Z U V */
 
+/* OR into the len of the polygon fill functions when every vertex is
+ * known to be strictly inside the viewport, skips 2D clipping */
+#define PL_NOCLIP            0x100
+
 extern int  PL_polygon_count; /* number of polygons rendered */
 
+/* Guard band, polygons crossing the viewport edges whose projected
+ * coordinates stay within 256 pixels of the viewport are scanned without
+ * clipping, their spans are cut to the viewport instead */
+extern int  PL_guard_band; /* nonzero to enable, on by default */
+extern int  PL_guard_band_count; /* polygons that skipped clipping */
+
+#define PL_ILACE_OFF         0
+#define PL_ILACE_ON          1 /* only render every other scanline */
+#define PL_ILACE_BLEND       2 /* PL_ILACE_ON + blend old scanlines
+                                * on present */
+
+/* Interlaced rendering, the scanlines of one parity (PL_field) are cleared
+ * and rasterized, the others keep what was rendered the frame before.
+ * PL_present switches PL_field for the next frame.
+ */
+extern int  PL_interlace; /* PL_ILACE_* */
+extern int  PL_field;     /* parity of the scanlines being rendered */
+
 extern int  PL_hres;       /* horizontal resolution */
 extern int  PL_vres;       /* vertical resolution */
 extern int  PL_hres_h;     /* half resolutions */
 extern int  PL_vres_h;
 
+/* when PL_TILE_LOG is nonzero these are in tiled order */
 extern int *PL_video_buffer;
 extern int *PL_depth_buffer;
 
+/* number of 4x4 texel blocks in a block compressed texture */
+#define PL_BC_BLOCKS    ((PL_REQ_TEX_DIM >> 2) * (PL_REQ_TEX_DIM >> 2))
+
 /* only square textures with dimensions of PL_REQ_TEX_DIM */
 struct PL_TEX {
     int *data; /* 4 byte-per-pixel true color X8R8G8B8 color data */
+    /* optional block compressed texture data, 2 integers per 4x4 block:
+     * [endpoint 1 R5G6B5 << 16 | endpoint 0 R5G6B5] [16 2-bit indices]
+     * when present it is used instead of 'data' */
+    int *bc;
 };
 
 /* Call this to initialize PL
@@ -187,11 +353,74 @@ struct PL_TEX {
  */
 extern void PL_init(int *video, int hres, int vres);
 
+/* Dynamic resolution
+ *
+ * Shrinks or grows the render target (PL_hres x PL_vres, packed at the
+ * start of the video memory given to PL_init) between frames so that the
+ * frame time stays within a budget. The image then has to be stretched
+ * over the whole display, e.g. with FW's vid_blitsub(PL_hres, PL_vres).
+ *
+ * target_ms - frame time budget in milliseconds, 0 disables the controller
+ *             and returns to full resolution
+ * min_scale - lower limit of the scale in 1/PL_DR_STEPS of full resolution
+ */
+#define PL_DR_STEPS    16
+extern void PL_dynres(int target_ms, int min_scale);
+/* report the time the last frame took,
+ * returns nonzero if the render target size was changed */
+extern int  PL_dynres_frame(int frame_ms);
+
+/* hand the finished image over to the video memory given to PL_init,
+ * call this once per frame before displaying it */
+extern void PL_present(void);
+
+/* Frame probing
+ *
+ * Between PL_probe_begin and PL_probe_end, PL_clear_*_vp,
+ * PL_render_object and PL_render_instances draw nothing. They only fold
+ * what they would draw with (object, level of detail, textures,
+ * model+view matrix, viewport, fov, raster and cull modes) into a
+ * signature of the frame. Running a frame's drawing code this way first
+ * tells if it would only reproduce the image that is already shown, so
+ * clearing, rendering and presenting it can be skipped. Changes PL can't
+ * see, like edited vertices or texels of an existing object, have to be
+ * folded in with PL_probe_fold.
+ */
+extern int  PL_probe; /* nonzero between PL_probe_begin and PL_probe_end */
+extern void PL_probe_begin(void);
+/* returns nonzero if the frame has to be drawn */
+extern int  PL_probe_end(void);
+extern void PL_probe_fold(int *v, int n);
+
 /* clear viewport color and depth */
 extern void PL_clear_vp      (int r, int g, int b);
 extern void PL_clear_color_vp(int r, int g, int b); /* clear viewport color */
 extern void PL_clear_depth_vp(void); /* clear viewport depth */
 
+/* Static layer
+ *
+ * For scenes where most things stand still, the geometry that doesn't
+ * move is drawn once and kept aside with its depth. Later frames start
+ * from a copy of it instead of a clear and only draw what moves:
+ *
+ *     PL_set_camera(...);
+ *     if (!PL_layer_restore()) {
+ *         PL_clear_vp(0, 0, 0);
+ *         ... draw static objects ...
+ *         PL_layer_save();
+ *     }
+ *     ... draw dynamic objects ...
+ *
+ * The layer covers the viewport and is dropped when the camera, fov,
+ * viewport, resolution, raster or cull mode or PL_cur_tex change. Call
+ * PL_layer_invalidate after moving or editing a static object. While
+ * probing, PL_layer_restore returns 0 and PL_layer_save does nothing.
+ */
+extern void PL_layer_save(void); /* keep viewport color and depth */
+/* returns nonzero if the saved layer was still valid and copied back */
+extern int  PL_layer_restore(void);
+extern void PL_layer_invalidate(void);
+
 /* Solid color polygon fill.
  * Expecting input stream of 3 values [X,Y,Z] */
 extern void PL_flat_poly(int *stream, int len, int rgb);
@@ -200,6 +429,30 @@ extern void PL_flat_poly(int *stream, int len, int rgb);
  * Expecting input stream of 5 values [X,Y,Z,U,V] */
 extern void PL_lintx_poly(int *stream, int len, int *texel);
 
+/* Affine texture mapped polygon fill from a block compressed texture.
+ * Expecting input stream of 5 values [X,Y,Z,U,V] */
+extern void PL_bctx_poly(int *stream, int len, int *blocks);
+
+/* Affine texture mapped polygon fill for textures that hold finished
+ * images, like impostors. Texels are written as they are, without the
+ * distance shading, and texels of the color PL_TEX_KEY are left out.
+ * Expecting input stream of 5 values [X,Y,Z,U,V] */
+#define PL_TEX_KEY   0xff00ff
+extern void PL_keytx_poly(int *stream, int len, int *texels);
+
+/* Render to texture
+ *
+ * PL_target_tex(tex) sends all drawing into tex->data, a PL_REQ_TEX_DIM
+ * square image with a depth buffer of its own, with the viewport set to
+ * cover it. The viewport functions and clears work on it like on the
+ * screen. PL_target_tex(NULL) goes back to the screen as it was left.
+ */
+extern void PL_target_tex(struct PL_TEX *tex);
+
+/* build the block compressed version of tex->data into tex->bc,
+ * returns the number of bytes saved if tex->data is freed afterwards */
+extern int  PL_tex_compress(struct PL_TEX *tex);
+
 /*****************************************************************************/
 /*********************************** MATH ************************************/
 /*****************************************************************************/
@@ -238,6 +491,8 @@ extern int PL_cos[PL_TRIGMAX];
 
 extern int  PL_winding_order  (int *a, int *b, int *c);
 extern void PL_vec_shorten    (int *v); /* shorten vector to fit in 15 bits */
+extern int  PL_isqrt          (int x); /* floor of square root */
+extern int  PL_vec_len        (int *v); /* length of XYZ, rounded up */
 extern void PL_psp_project    (int *src, int *dst, int len, int num, int fov);
 
 /* matrix stack (mst) */
@@ -253,13 +508,52 @@ extern void PL_mst_rotatex    (int rx);
 extern void PL_mst_rotatey    (int ry);
 extern void PL_mst_rotatez    (int rz);
 extern void PL_set_camera(int x, int y, int z, int rx, int ry);
-
-/* transform a stream of vertices by the current model+view */
+/* set/get the camera as a world to view space matrix,
+ * allows roll or any other affine camera */
+extern void PL_set_camera_mat(int *m);
+extern void PL_get_camera_mat(int *m);
+
+/* transform a stream of vertices by the current model+view.
+ * the two are composed into one matrix the first time they are used
+ * after either one changes */
 extern void PL_mst_xf_modelview_vec(int *v, int *out, int len);
+/* same as above but reads vertices in the PL_OBJ soa layout */
+extern void PL_mst_xf_modelview_soa(int *soa, int *out, int len);
+/* transform a bounding sphere [x, y, z, radius] to view space,
+ * the radius is grown by the largest scale of the model+view */
+extern void PL_mst_xf_sphere(int *s, int *out);
+/* camera position [x, y, z] in the object space of the current model+view.
+ * returns the sign of the determinant, 0 if it can't be inverted */
+extern int  PL_mst_eye(int *eye);
 
 /* result is stored in 'a' */
 extern void PL_mat_mul(int *a, int *b);
 extern void PL_mat_cpy(int *dst, int *src);
+/* get the current model+view, composed if it changed */
+extern void PL_mst_get_mv(int *m);
+
+/* node of a transform hierarchy. the world matrix is cached and only
+ * made again when the node or one of its parents changed */
+struct PL_XFNODE {
+    struct PL_XFNODE *parent; /* NULL for a root */
+    int local[16]; /* relative to the parent, applied before it */
+    int world[16]; /* local then all of the parents, use PL_xf_world */
+    int dirty; /* local changed since world was made */
+    unsigned stamp; /* changes every time world is made */
+    unsigned parent_stamp; /* stamp of the parent world was made from */
+    unsigned checked; /* last change to any node when world was checked */
+};
+
+/* start a node with an identity local matrix */
+extern void PL_xf_init(struct PL_XFNODE *n, struct PL_XFNODE *parent);
+/* give a node a new local matrix */
+extern void PL_xf_set(struct PL_XFNODE *n, int *local);
+/* mark a node changed after writing to its local matrix directly */
+extern void PL_xf_dirty(struct PL_XFNODE *n);
+/* world matrix of a node, brought up to date if needed */
+extern int *PL_xf_world(struct PL_XFNODE *n);
+/* load the world matrix of a node onto the matrix stack */
+extern void PL_xf_load(struct PL_XFNODE *n);
 
 /*****************************************************************************/
 /************************************ GEN ************************************/
@@ -286,11 +580,90 @@ extern struct PL_OBJ *PL_gen_box(
         int side_flags,
         int r, int g, int b);
 
+/*****************************************************************************/
+/*********************************** SCENE ***********************************/
+/*****************************************************************************/
+
+/* max objects in a leaf of the bounding volume hierarchy */
+#define PL_SCN_LEAF 4
+
+/* an object placed in a scene */
+struct PL_SCN_ENT {
+    struct PL_OBJ *obj;
+    int mat[16]; /* model matrix, object to world space */
+    int bbox[6]; /* world space bounds, min x, y, z, max x, y, z */
+    int leaf; /* node it is in, -1 if it has no bounds */
+};
+
+/* node of the bounding volume hierarchy, a leaf if left is -1 */
+struct PL_SCN_NODE {
+    int bbox[6];
+    int parent;
+    int left, right;
+    int first, count; /* range of the scene's ent_order in a leaf */
+};
+
+/* zero it out before the first use, free what it holds with
+ * PL_scene_delete. world space is the space of the top of the matrix
+ * stack when the scene is culled and rendered */
+struct PL_SCENE {
+    struct PL_SCN_ENT *ents;
+    int n_ents, ent_cap;
+    struct PL_SCN_NODE *nodes;
+    int n_nodes, node_cap;
+    int *ent_order; /* entities in leaf order, then those without bounds */
+    int n_bounded; /* entities in the hierarchy */
+    int built; /* the hierarchy holds every entity */
+    /* filled in by PL_scene_cull, [entity, view space z] pairs
+     * of the visible entities from near to far */
+    int *visible;
+    int n_visible, vis_cap;
+};
+
+/* add obj under model matrix mat, returns its entity index */
+extern int  PL_scene_add(struct PL_SCENE *scn, struct PL_OBJ *obj, int *mat);
+/* give an entity a new model matrix. the hierarchy is refit from its
+ * leaf up, so it stays valid but gets looser the further things move */
+extern void PL_scene_move(struct PL_SCENE *scn, int ent, int *mat);
+/* (re)build the hierarchy, done for you after entities were added */
+extern void PL_scene_build(struct PL_SCENE *scn);
+/* find the visible entities, returns how many are in scn->visible */
+extern int  PL_scene_cull(struct PL_SCENE *scn);
+/* cull and render the visible entities from near to far */
+extern void PL_scene_render(struct PL_SCENE *scn);
+extern void PL_scene_delete(struct PL_SCENE *scn);
+
+/*****************************************************************************/
+/********************************* IMPOSTOR **********************************/
+/*****************************************************************************/
+
+/* Impostors
+ *
+ * An object that is under px pixels in radius on screen is drawn as one
+ * textured quad facing the camera. The texture is a picture of the
+ * object rendered from where the camera sees it, reused until the object
+ * turns by about 2 degrees against the view or moves by about 3% of its
+ * distance. The textures come from a cache with room for as many as fit
+ * in the budget, the least recently used one is rendered over when it
+ * runs out. Without a budget objects are drawn as they are.
+ */
+extern int  PL_impostor_updates; /* textures rendered, not reset by PL */
+/* texture memory in bytes the cache may use, 0 frees it */
+extern void PL_impostor_budget(int bytes);
+/* draw obj at the current matrix, as an impostor while it is under px
+ * pixels in radius. one object drawn in several places needs a
+ * different id for each */
+extern void PL_render_impostor(struct PL_OBJ *obj, int id, int px);
+/* forget every impostor, for after editing an object that has one */
+extern void PL_impostor_flush(void);
+
 /*****************************************************************************/
 /********************************* IMPORTER **********************************/
 /*****************************************************************************/
 
 extern int import_dmdl(char *name, struct PL_OBJ **o); /* import DMDL object */
+/* write an object out as a DMDL file, textures are written as ID 0 */
+extern int export_dmdl(char *name, struct PL_OBJ *o);
 
 /*****************************************************************************/
 /******************************* USER DEFINED ********************************/
@@ -0,0 +1,416 @@
+/*****************************************************************************/
+/*
+ * PiSHi LE (Lite edition) - Fundamentals of the King's Crook graphics engine.
+ *
+ *   by EMMIR 2018-2022
+ *
+ *   YouTube: https://www.youtube.com/c/LMP88
+ *
+ * This software is released into the public domain.
+ */
+/*****************************************************************************/
+
+#include "pl.h"
+
+/*  scene.c
+ *
+ * Scene of objects placed in world space, kept in a bounding volume
+ * hierarchy of boxes so culling only walks the parts that are in view.
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+/* deep enough for any hierarchy made by splitting at the median */
+#define STACK_DEPTH 64
+
+static void *
+grow(void *buf, int *cap, int n, int esz)
+{
+    void *nbuf;
+    int ncap;
+
+    if (n < *cap) {
+        return buf;
+    }
+    ncap = (*cap > 0) ? (*cap * 2) : 64;
+    while (ncap <= n) {
+        ncap *= 2;
+    }
+    nbuf = EXT_calloc(ncap, esz);
+    if (nbuf == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "scene", "no memory");
+        return buf;
+    }
+    if (buf) {
+        memcpy(nbuf, buf, *cap * esz);
+        EXT_free(buf);
+    }
+    *cap = ncap;
+    return nbuf;
+}
+
+/* world space bounds of an entity, the box around its object's
+ * bounding box corners under its matrix */
+static void
+ent_bounds(struct PL_SCN_ENT *e)
+{
+    int *b = e->obj->bbox;
+    int *m = e->mat;
+    int i, j, w;
+    int c[3];
+
+    for (i = 0; i < 8; i++) {
+        c[0] = b[(i & 1) ? 3 : 0];
+        c[1] = b[(i & 2) ? 4 : 1];
+        c[2] = b[(i & 4) ? 5 : 2];
+        for (j = 0; j < 3; j++) {
+            w = ((c[0] * m[0 + j] + c[1] * m[4 + j] + c[2] * m[8 + j] +
+                 (1 << (PL_P - 1))) >> PL_P) + m[12 + j];
+            if (i == 0 || w < e->bbox[j]) {
+                e->bbox[j] = w;
+            }
+            if (i == 0 || w > e->bbox[3 + j]) {
+                e->bbox[3 + j] = w;
+            }
+        }
+    }
+}
+
+static void
+box_union(int *dst, int *src)
+{
+    int j;
+
+    for (j = 0; j < 3; j++) {
+        if (src[j] < dst[j]) {
+            dst[j] = src[j];
+        }
+        if (src[3 + j] > dst[3 + j]) {
+            dst[3 + j] = src[3 + j];
+        }
+    }
+}
+
+/* view space bounding sphere of a world space box */
+static void
+box_sphere(int *box, int *out)
+{
+    int s[4], h[3];
+    int j;
+
+    for (j = 0; j < 3; j++) {
+        s[j] = box[j] + ((box[3 + j] - box[j]) >> 1);
+        h[j] = box[3 + j] - s[j];
+    }
+    s[3] = PL_vec_len(h) + 1;
+    PL_mst_xf_sphere(s, out);
+}
+
+/* bounds of a leaf from its entities */
+static void
+leaf_bounds(struct PL_SCENE *scn, struct PL_SCN_NODE *n)
+{
+    int i;
+
+    memcpy(n->bbox, scn->ents[scn->ent_order[n->first]].bbox,
+           sizeof(n->bbox));
+    for (i = 1; i < n->count; i++) {
+        box_union(n->bbox, scn->ents[scn->ent_order[n->first + i]].bbox);
+    }
+}
+
+static struct PL_SCENE *sort_scn;
+static int sort_axis;
+
+static int
+cmp_center(const void *a, const void *b)
+{
+    int *ba, *bb;
+
+    ba = sort_scn->ents[*(const int *) a].bbox;
+    bb = sort_scn->ents[*(const int *) b].bbox;
+    /* centers, doubled */
+    return (ba[sort_axis] + ba[3 + sort_axis]) -
+           (bb[sort_axis] + bb[3 + sort_axis]);
+}
+
+/* node for count entities from ent_order[first], split at the
+ * median of the longest axis of their centers */
+static int
+build_node(struct PL_SCENE *scn, int first, int count, int parent)
+{
+    struct PL_SCN_NODE *n;
+    int lo[3], hi[3];
+    int i, j, c, idx, mid, l, r, *b;
+
+    idx = scn->n_nodes++;
+    n = &scn->nodes[idx];
+    n->parent = parent;
+    n->first = first;
+    n->count = count;
+    n->left = -1;
+    n->right = -1;
+    if (count <= PL_SCN_LEAF) {
+        for (i = 0; i < count; i++) {
+            scn->ents[scn->ent_order[first + i]].leaf = idx;
+        }
+        leaf_bounds(scn, n);
+        return idx;
+    }
+    for (i = 0; i < count; i++) {
+        b = scn->ents[scn->ent_order[first + i]].bbox;
+        for (j = 0; j < 3; j++) {
+            c = b[j] + b[3 + j];
+            if (i == 0 || c < lo[j]) {
+                lo[j] = c;
+            }
+            if (i == 0 || c > hi[j]) {
+                hi[j] = c;
+            }
+        }
+    }
+    sort_axis = 0;
+    for (j = 1; j < 3; j++) {
+        if ((hi[j] - lo[j]) > (hi[sort_axis] - lo[sort_axis])) {
+            sort_axis = j;
+        }
+    }
+    sort_scn = scn;
+    qsort(scn->ent_order + first, count, sizeof(int), cmp_center);
+    mid = count / 2;
+    l = build_node(scn, first, mid, idx);
+    r = build_node(scn, first + mid, count - mid, idx);
+    /* the nodes don't move, they were allocated up front */
+    n->left = l;
+    n->right = r;
+    memcpy(n->bbox, scn->nodes[l].bbox, sizeof(n->bbox));
+    box_union(n->bbox, scn->nodes[r].bbox);
+    return idx;
+}
+
+extern int
+PL_scene_add(struct PL_SCENE *scn, struct PL_OBJ *obj, int *mat)
+{
+    struct PL_SCN_ENT *e;
+
+    if (!scn || !obj) {
+        EXT_error(PL_ERR_MISC, "scene", "null scene or object");
+        return -1;
+    }
+    scn->ents = grow(scn->ents, &scn->ent_cap, scn->n_ents,
+                     sizeof(struct PL_SCN_ENT));
+    e = &scn->ents[scn->n_ents];
+    memset(e, 0, sizeof(*e));
+    e->obj = obj;
+    PL_mat_cpy(e->mat, mat);
+    e->leaf = -1;
+    if (obj->bsphere[3] > 0) {
+        ent_bounds(e);
+    }
+    scn->built = 0;
+    return scn->n_ents++;
+}
+
+extern void
+PL_scene_move(struct PL_SCENE *scn, int ent, int *mat)
+{
+    struct PL_SCN_ENT *e;
+    struct PL_SCN_NODE *n;
+    int old[6];
+    int i;
+
+    if (!scn || ent < 0 || ent >= scn->n_ents) {
+        return;
+    }
+    e = &scn->ents[ent];
+    PL_mat_cpy(e->mat, mat);
+    if (e->obj->bsphere[3] <= 0) {
+        return;
+    }
+    ent_bounds(e);
+    if (!scn->built || e->leaf < 0) {
+        return;
+    }
+    /* refit up to the root, or until a node stays the same */
+    i = e->leaf;
+    n = &scn->nodes[i];
+    memcpy(old, n->bbox, sizeof(old));
+    leaf_bounds(scn, n);
+    while (memcmp(old, n->bbox, sizeof(old)) != 0 && n->parent >= 0) {
+        n = &scn->nodes[n->parent];
+        memcpy(old, n->bbox, sizeof(old));
+        memcpy(n->bbox, scn->nodes[n->left].bbox, sizeof(n->bbox));
+        box_union(n->bbox, scn->nodes[n->right].bbox);
+    }
+}
+
+extern void
+PL_scene_build(struct PL_SCENE *scn)
+{
+    int i, n;
+
+    if (!scn) {
+        return;
+    }
+    if (scn->ent_order) {
+        EXT_free(scn->ent_order);
+    }
+    scn->ent_order = EXT_calloc(scn->n_ents ? scn->n_ents : 1, sizeof(int));
+    if (scn->ent_order == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "scene", "no memory");
+        return;
+    }
+    /* the ones with bounds first, then the ones without */
+    n = 0;
+    for (i = 0; i < scn->n_ents; i++) {
+        scn->ents[i].leaf = -1;
+        if (scn->ents[i].obj->bsphere[3] > 0) {
+            scn->ent_order[n++] = i;
+        }
+    }
+    scn->n_bounded = n;
+    for (i = 0; i < scn->n_ents; i++) {
+        if (scn->ents[i].obj->bsphere[3] <= 0) {
+            scn->ent_order[n++] = i;
+        }
+    }
+    n = scn->n_bounded;
+    /* a binary tree with at least one entity per leaf */
+    if (scn->nodes) {
+        EXT_free(scn->nodes);
+    }
+    scn->nodes = EXT_calloc(n ? n * 2 : 1, sizeof(struct PL_SCN_NODE));
+    if (scn->nodes == NULL) {
+        EXT_error(PL_ERR_NO_MEM, "scene", "no memory");
+        return;
+    }
+    scn->node_cap = n * 2;
+    scn->n_nodes = 0;
+    if (n > 0) {
+        build_node(scn, 0, n, -1);
+    }
+    scn->built = 1;
+}
+
+/* add an entity to the visible list with the view space z of its center */
+static void
+emit(struct PL_SCENE *scn, int ent, int z)
+{
+    scn->visible = grow(scn->visible, &scn->vis_cap, scn->n_visible,
+                        2 * sizeof(int));
+    scn->visible[scn->n_visible * 2 + 0] = ent;
+    scn->visible[scn->n_visible * 2 + 1] = z;
+    scn->n_visible++;
+}
+
+static int
+cmp_depth(const void *a, const void *b)
+{
+    return ((const int *) a)[1] - ((const int *) b)[1];
+}
+
+extern int
+PL_scene_cull(struct PL_SCENE *scn)
+{
+    int stack[STACK_DEPTH * 2];
+    int sph[4], c[PL_VLEN], v[PL_VLEN];
+    int i, sp, vis, evis, ni;
+    struct PL_SCN_NODE *n;
+    struct PL_SCN_ENT *e;
+
+    if (!scn) {
+        return 0;
+    }
+    if (!scn->built) {
+        PL_scene_build(scn);
+    }
+    scn->n_visible = 0;
+    /* objects without bounds are always drawn */
+    for (i = scn->n_bounded; i < scn->n_ents; i++) {
+        e = &scn->ents[scn->ent_order[i]];
+        memset(c, 0, sizeof(c));
+        memcpy(c, e->mat + 12, 3 * sizeof(int));
+        PL_mst_xf_modelview_vec(c, v, 1);
+        emit(scn, scn->ent_order[i], v[2]);
+    }
+    sp = 0;
+    if (scn->n_nodes > 0) {
+        stack[sp++] = 0;
+        stack[sp++] = PL_VIS_PARTIAL;
+    }
+    while (sp > 0) {
+        vis = stack[--sp];
+        ni = stack[--sp];
+        n = &scn->nodes[ni];
+        if (vis == PL_VIS_PARTIAL) {
+            box_sphere(n->bbox, sph);
+            vis = PL_sphere_frustum_test(sph);
+            if (vis == PL_VIS_OUTSIDE) {
+                continue;
+            }
+        }
+        if (n->left >= 0) {
+            if (sp + 4 > STACK_DEPTH * 2) {
+                EXT_error(PL_ERR_MISC, "scene", "hierarchy too deep");
+                break;
+            }
+            stack[sp++] = n->right;
+            stack[sp++] = vis;
+            stack[sp++] = n->left;
+            stack[sp++] = vis;
+            continue;
+        }
+        for (i = 0; i < n->count; i++) {
+            e = &scn->ents[scn->ent_order[n->first + i]];
+            box_sphere(e->bbox, sph);
+            evis = vis;
+            if (evis == PL_VIS_PARTIAL) {
+                evis = PL_sphere_frustum_test(sph);
+            }
+            if (evis != PL_VIS_OUTSIDE) {
+                emit(scn, scn->ent_order[n->first + i], sph[2]);
+            }
+        }
+    }
+    qsort(scn->visible, scn->n_visible, 2 * sizeof(int), cmp_depth);
+    return scn->n_visible;
+}
+
+extern void
+PL_scene_render(struct PL_SCENE *scn)
+{
+    struct PL_SCN_ENT *e;
+    int i;
+
+    PL_scene_cull(scn);
+    for (i = 0; i < scn->n_visible; i++) {
+        e = &scn->ents[scn->visible[i * 2]];
+        PL_mst_push();
+        PL_mst_mul(e->mat);
+        PL_render_object(e->obj);
+        PL_mst_pop();
+    }
+}
+
+extern void
+PL_scene_delete(struct PL_SCENE *scn)
+{
+    if (!scn) {
+        return;
+    }
+    if (scn->ents) {
+        EXT_free(scn->ents);
+    }
+    if (scn->nodes) {
+        EXT_free(scn->nodes);
+    }
+    if (scn->ent_order) {
+        EXT_free(scn->ent_order);
+    }
+    if (scn->visible) {
+        EXT_free(scn->visible);
+    }
+    memset(scn, 0, sizeof(*scn));
+}